@@ -46,12 +46,30 @@ extern "C" {
 
 typedef struct fa_dirinfo_t fa_dirinfo_t;
 typedef struct fa_archiveinfo_t fa_archiveinfo_t;
+typedef struct fa_direntries_t fa_direntries_t;
+typedef struct fa_io_ops_t fa_io_ops_t;
+typedef struct fa_compression_options_t fa_compression_options_t;
 
-/*! Mode for archive access */
+typedef void* fa_io_handle_t; /*!< I/O handle, as returned by fa_io_ops_t.open */
+
+#if defined(_WIN32)
+#define FA_IO_INVALID_HANDLE ((fa_io_handle_t)-1) /*!< I/O handle returned by fa_io_ops_t.open on failure */
+#else
+#define FA_IO_INVALID_HANDLE (NULL) /*!< I/O handle returned by fa_io_ops_t.open on failure */
+#endif
+
+/*!
+ * Mode for archive access
+ *
+ * The bits within FA_MODE_MASK select the access mode (FA_MODE_READ or FA_MODE_WRITE); the flags above it are combined with the access mode using '|'
+ */
 typedef enum
 {
 	FA_MODE_READ = 0, /*!< Open archive for read access. No methods writing data to the archive are accessible in this mode */
-	FA_MODE_WRITE = 1 /*!< Open archive for write access. No methods reading, seeking or enumerating entries in the archive are available in this mode */
+	FA_MODE_WRITE = 1, /*!< Open archive for write access. No methods reading, seeking or enumerating entries in the archive are available in this mode */
+	FA_MODE_MASK = 0xff, /*!< Mask selecting the access mode from a mode combined with flags */
+	FA_MODE_MAPPED = 0x100, /*!< Flag combined with FA_MODE_READ; access the archive through a read-only memory mapping, allowing uncompressed entries to be accessed in place using fa_map() */
+	FA_MODE_CONCURRENT = 0x200 /*!< Flag combined with FA_MODE_READ; files in the archive may be opened, read and closed from several threads at once, each file giving its own read-ahead window. A single file must still only be used by one thread at a time, except through fa_pread(). Opening fails on platforms without thread support */
 } fa_mode_t;
 
 /*! What origin to use when seeking inside an archive file */
@@ -85,12 +103,54 @@ struct fa_dirinfo_t
 	fa_hash_t hash; /*!< Content hash for entry */
 };
 
+struct fa_direntries_t
+{
+	const void* toc; /*!< Start of the TOC; name offsets in the entries are relative to this */
+	const fa_entry_t* entries; /*!< File entries in the directory, only valid as long as archive is opened */
+	const fa_hash_t* hashes; /*!< Content hashes, parallel to entries */
+	uint32_t count; /*!< Number of file entries */
+};
+
+#define FA_COMPRESSION_LEVEL_DEFAULT (0) /*!< Use the default level of each compression method */
+#define FA_COMPRESSION_LEVEL_FASTEST (1) /*!< Fastest compression level */
+#define FA_COMPRESSION_LEVEL_BEST (9) /*!< Slowest compression level, giving the smallest output */
+
+struct fa_compression_options_t
+{
+	int level; /*!< Compression level from FA_COMPRESSION_LEVEL_FASTEST to FA_COMPRESSION_LEVEL_BEST, scaled onto the range of each compression method, or FA_COMPRESSION_LEVEL_DEFAULT */
+};
+
 struct fa_archiveinfo_t
 {
 	fa_header_t header; /*!< Header as written to archive */
 	fa_footer_t footer; /*!< Footer as written to archive */
 };
 
+/*!
+ * \brief I/O operations used to access archive storage
+ *
+ * Reading requires open, close, read, pread, lseek and tell; writing requires open, close and write. Any operation that is not used can be NULL.
+ */
+struct fa_io_ops_t
+{
+	fa_io_handle_t (*open)(const char* filename, fa_mode_t mode, void* context); /*!< Open storage, returning FA_IO_INVALID_HANDLE on failure; context is passed through from fa_open_archive_ex() */
+	int (*close)(fa_io_handle_t handle); /*!< Close storage, returning 0 if successful */
+
+	size_t (*read)(fa_io_handle_t handle, void* buffer, size_t length); /*!< Read from current offset, returning number of bytes read */
+	size_t (*pread)(fa_io_handle_t handle, void* buffer, size_t length, uint64_t offset); /*!< Read from absolute offset without moving the current offset, returning number of bytes read; must be safe to call concurrently */
+	size_t (*write)(fa_io_handle_t handle, const void* buffer, size_t length); /*!< Write at current offset, returning number of bytes written */
+	int (*lseek)(fa_io_handle_t handle, int64_t offset, fa_seek_t whence); /*!< Move current offset, returning 0 if successful */
+	size_t (*tell)(fa_io_handle_t handle); /*!< Return current offset */
+
+	const void* (*map)(fa_io_handle_t handle, uint64_t offset, size_t length); /*!< Optional; return a pointer to length bytes of storage at offset that stays valid until the handle is closed, or NULL if not available */
+};
+
+/*! Callback invoked when an asynchronous read has completed; length is the number of bytes actually read into buffer */
+typedef void (*fa_read_callback_t)(fa_file_t* file, void* buffer, size_t length, void* userdata);
+
+/*! Callback invoked for each entry visited by fa_walk(); path is the full path of the entry (directories end with '/') and is only valid during the call. Return non-zero to stop the walk */
+typedef int (*fa_walk_callback_t)(const char* path, const fa_dirinfo_t* info, void* userdata);
+
 /*! \defgroup libfilearchive
  * \{ */
 
@@ -103,7 +163,7 @@ struct fa_archiveinfo_t
  * \brief Open archive for reading or writing
  *
  * \param filename Path to archive
- * \param mode Mode to use when opening
+ * \param mode Mode to use when opening, optionally combined with FA_MODE_MAPPED and/or FA_MODE_CONCURRENT when reading
  * \param alignment Alignment for resulting archive when writing (when reading, pass 0)
  * \param info When reading, this structure will be filled with info about the archive (can be NULL)
  *
@@ -111,6 +171,33 @@ struct fa_archiveinfo_t
  */
 fa_archive_t* fa_open_archive(const char* filename, fa_mode_t mode, uint32_t alignment, fa_archiveinfo_t* info);
 
+/*!
+ *
+ * \brief Open archive for reading or writing through custom I/O operations
+ *
+ * \param filename Path to archive, passed on to fa_io_ops_t.open
+ * \param mode Mode to use when opening
+ * \param alignment Alignment for resulting archive when writing (when reading, pass 0)
+ * \param info When reading, this structure will be filled with info about the archive (can be NULL)
+ * \param ops I/O operations used to access the archive (if NULL, the same operations as fa_open_archive() are used)
+ * \param context User context passed on to fa_io_ops_t.open
+ *
+ * \note The operations must stay valid as long as the archive is opened
+ */
+fa_archive_t* fa_open_archive_ex(const char* filename, fa_mode_t mode, uint32_t alignment, fa_archiveinfo_t* info, const fa_io_ops_t* ops, void* context);
+
+/*!
+ *
+ * \brief Open archive stored in memory for reading
+ *
+ * \param data Archive data; must stay valid as long as the archive is opened
+ * \param size Size of archive data
+ * \param info This structure will be filled with info about the archive (can be NULL)
+ *
+ * \note An uncompressed TOC is used in place, uncompressed files can be accessed in place using fa_map() and compressed files are decompressed directly from the archive data
+ */
+fa_archive_t* fa_open_archive_memory(const void* data, size_t size, fa_archiveinfo_t* info);
+
 /*!
  *
  * \brief Close previously opened archive and finalize changes
@@ -122,6 +209,104 @@ fa_archive_t* fa_open_archive(const char* filename, fa_mode_t mode, uint32_t ali
  */
 int fa_close_archive(fa_archive_t* archive, fa_compression_t compression, fa_archiveinfo_t* info);
 
+/*!
+ *
+ * \brief Configure cache of decompressed blocks shared by all files in archive
+ *
+ * \param archive Archive to configure
+ * \param budget Maximum number of bytes used by cached blocks, 0 disables the cache
+ *
+ * \return 0 if successful, <0 otherwise
+ *
+ * \note Blocks are evicted in least recently used order; changing the budget discards all cached blocks
+ * \note The cache may be shared by concurrent readers, but must not be reconfigured while files are being read
+ *
+ */
+int fa_set_block_cache(fa_archive_t* archive, size_t budget);
+
+/*!
+ *
+ * \brief Set the block size used when compressing files
+ *
+ * Larger blocks improve compression ratios and reduce per-block overhead for big files, at the cost of
+ * decoding a whole block for every small random read.
+ *
+ * \param archive Archive to configure; must be opened for writing, with no files written yet
+ * \param size Block size in bytes; a power of two between FA_BLOCK_SIZE_DEFAULT and FA_BLOCK_SIZE_MAX
+ *
+ * \return 0 if successful, <0 otherwise
+ *
+ * \note Archives using a block size above FA_BLOCK_SIZE_DEFAULT are written as FA_VERSION_3
+ *
+ */
+int fa_set_block_size(fa_archive_t* archive, uint32_t size);
+
+/*!
+ *
+ * \brief Set the compression dictionary used for FA_COMPRESSION_ZSTD files
+ *
+ * The dictionary is stored in the TOC and picked up automatically when the archive is opened for reading.
+ *
+ * \param archive Archive to configure; must be opened for writing, with no files written yet
+ * \param data Dictionary data, as produced by fa_train_dictionary() (copied)
+ * \param size Size of dictionary data in bytes
+ *
+ * \return 0 if successful, <0 otherwise
+ *
+ * \note Only available when built with Zstandard support (FA_ZSTD_ENABLE)
+ *
+ */
+int fa_set_dictionary(fa_archive_t* archive, const void* data, size_t size);
+
+/*!
+ *
+ * \brief Set compression options used when writing
+ *
+ * Levels only trade compression time against compressed size; archives are read the same way regardless of level.
+ *
+ * \param archive Archive to configure; must be opened for writing
+ * \param options Options to use, or NULL to restore the defaults (copied)
+ *
+ * \return 0 if successful, <0 otherwise
+ *
+ * \note Options apply to blocks compressed after the call, including the TOC
+ *
+ */
+int fa_set_compression_options(fa_archive_t* archive, const fa_compression_options_t* options);
+
+/*!
+ *
+ * \brief Train a compression dictionary from sample data
+ *
+ * Samples should resemble the data that will be compressed, ideally split at the same block size the archive uses.
+ *
+ * \param dictionary Buffer receiving the dictionary
+ * \param capacity Maximum size of the dictionary in bytes (around 100 KiB is typical)
+ * \param samples All samples, stored back to back
+ * \param sizes Size of each sample in bytes
+ * \param count Number of samples
+ *
+ * \return Size of the trained dictionary, 0 on failure
+ *
+ * \note Only available when built with Zstandard support (FA_ZSTD_ENABLE)
+ *
+ */
+size_t fa_train_dictionary(void* dictionary, size_t capacity, const void* samples, const size_t* sizes, uint32_t count);
+
+/*!
+ *
+ * \brief Return the I/O operations used for regular file access
+ *
+ */
+const fa_io_ops_t* fa_get_default_ops();
+
+/*!
+ *
+ * \brief Return the I/O operations used for memory mapped file access (FA_MODE_MAPPED)
+ *
+ */
+const fa_io_ops_t* fa_get_mapped_ops();
+
 /*! \} */
 
 /*!
@@ -144,6 +329,8 @@ int fa_close_archive(fa_archive_t* archive, fa_compression_t compression, fa_arc
  *
  * \note When writing, opening a file with the same name more than once will NOT replace the old one; a new instance will be created (but will be inaccessible by name)
  * \note When opening a file for reading, passing @ followed by a 40-character hexadecimal string will allow opening a file for access through its content hash
+ * \note Archives carrying a path index (FA_SECTION_PATHS) resolve names with a single hash lookup; older archives walk the container hierarchy
+ * \note Archives carrying a bloom filter (FA_SECTION_BLOOM) reject most missing names without touching the rest of the TOC
  *
  */
 fa_file_t* fa_open(fa_archive_t* archive, const char* filename, fa_compression_t compression, fa_dirinfo_t* info);
@@ -160,9 +347,41 @@ fa_file_t* fa_open(fa_archive_t* archive, const char* filename, fa_compression_t
  * \return File ready to read from
  *
  * \note This only supports read-access for obvious reasons
+ * \note Archives carrying a content hash index (FA_SECTION_HASHES) are binary searched; older archives are scanned linearly
+ * \note Missing hashes are usually rejected by the bloom filter (FA_SECTION_BLOOM) before the search
  */
 fa_file_t* fa_open_hash(fa_archive_t* archive, const fa_hash_t* hash);
 
+/*!
+ *
+ * \brief Look up an entry in the archive without opening it
+ *
+ * Resolves the name the same way as fa_open(), but only reads the TOC; no file handle is created and nothing is allocated.
+ *
+ * \param archive Archive to access
+ * \param filename File to look up (@ followed by a 40-character hexadecimal string looks up by content hash)
+ * \param info If specified, this instance will receive the name, compression, sizes and content hash of the entry
+ *
+ * \return 0 if the entry exists, -1 otherwise
+ *
+ * \note This only supports archives opened for reading
+ */
+int fa_stat(fa_archive_t* archive, const char* filename, fa_dirinfo_t* info);
+
+/*!
+ *
+ * \brief Look up an entry in the archive by content hash without opening it
+ *
+ * \param archive Archive to access
+ * \param hash Hash to use as key
+ * \param info If specified, this instance will receive the name, compression, sizes and content hash of the entry
+ *
+ * \return 0 if the entry exists, -1 otherwise
+ *
+ * \note This only supports archives opened for reading
+ */
+int fa_stat_hash(fa_archive_t* archive, const fa_hash_t* hash, fa_dirinfo_t* info);
+
 /*!
  *
  * \brief Close a file and finalize changes
@@ -190,6 +409,88 @@ int fa_close(fa_file_t* file, fa_dirinfo_t* info);
  */
 size_t fa_read(fa_file_t* file, void* buffer, size_t length);
 
+/*!
+ *
+ * \brief Read data from an absolute offset in file
+ *
+ * \param file File to read data from
+ * \param buffer Buffer that receives read data
+ * \param length Number of bytes to attempt to read
+ * \param offset Offset in file to start reading from
+ *
+ * \return Number of bytes actually read from file
+ *
+ * \note The current offset of the file is neither used nor modified, and the call may be made concurrently from several threads on the same file
+ * \note This method will transparently decompress data
+ *
+ */
+size_t fa_pread(fa_file_t* file, void* buffer, size_t length, uint64_t offset);
+
+/*!
+ *
+ * \brief Decompress file in the background ahead of reading
+ *
+ * \param file File to configure
+ * \param depth Number of blocks a worker thread keeps read and decompressed ahead of fa_read(), 0 disables read-ahead
+ *
+ * \return 0 if successful, <0 otherwise
+ *
+ * \note Only available for compressed files on platforms with thread support; intended for sequential streaming, as seeking restarts the read-ahead
+ * \note Asynchronous reads are not available while read-ahead is enabled
+ *
+ */
+int fa_set_readahead(fa_file_t* file, uint32_t depth);
+
+/*!
+ *
+ * \brief Queue an asynchronous read from file
+ *
+ * \param file File to read data from
+ * \param buffer Buffer that receives read data; must stay valid until the callback has been invoked
+ * \param length Number of bytes to attempt to read
+ * \param callback Callback invoked from fa_poll() once the read has completed
+ * \param userdata User data passed on to the callback
+ *
+ * \return 0 if the read was queued, <0 otherwise (including when the file already has a read queued)
+ *
+ * \note Reading starts at the current offset in the file, which is advanced when the read completes; the file may not be accessed until then
+ * \note Only one read may be queued per file; closing the file completes a queued read, invoking its callback first
+ * \note Compressed data is decompressed when the read completes
+ *
+ */
+int fa_read_async(fa_file_t* file, void* buffer, size_t length, fa_read_callback_t callback, void* userdata);
+
+/*!
+ *
+ * \brief Submit queued asynchronous reads and process the ones that have completed
+ *
+ * \param archive Archive to process reads for
+ * \param wait If non-zero, block until at least one read has completed
+ *
+ * \return Number of reads completed, <0 on error
+ *
+ * \note When built with FA_URING_ENABLE, reads are submitted in batches through io_uring; otherwise they are carried out synchronously by this call
+ * \note Closing the archive completes all outstanding reads
+ * \note Asynchronous reads are queued per archive; fa_read_async() and fa_poll() must not be called concurrently, even with FA_MODE_CONCURRENT
+ *
+ */
+int fa_poll(fa_archive_t* archive, int wait);
+
+/*!
+ *
+ * \brief Access the contents of a file in place
+ *
+ * \param file File to access
+ * \param data Receives a pointer to the file contents
+ * \param length Receives the size of the file contents
+ *
+ * \return 0 if operation was successful, <0 otherwise
+ *
+ * \note Only available for uncompressed files in archives opened with FA_MODE_MAPPED; the data is valid as long as the archive is opened
+ *
+ */
+int fa_map(fa_file_t* file, const void** data, size_t* length);
+
 /*!
  *
  * \brief Write data to file
@@ -214,6 +515,7 @@ size_t fa_write(fa_file_t* file, const void* buffer, size_t length);
  * \return 0 if seeking was successful, <0 otherwise
  *
  * \note Seeking when writing is not supported
+ * \note Seeking in compressed entries only decodes the target block when the archive has a block index (version 2 and later); older archives walk the block headers
  *
  */
 int fa_lseek(fa_file_t* file, int64_t offset, fa_seek_t whence);
@@ -246,6 +548,7 @@ size_t fa_tell(fa_file_t* file);
  * \return Handle to use when enumerating
  *
  * \note Enumerating when writing is not supported
+ * \note Archives carrying a container index (FA_SECTION_CHILDREN) resolve each path component with a binary search, and list subdirectories sorted by name
  *
  */
 fa_dir_t* fa_opendir(fa_archive_t* archive, const char* dir);
@@ -262,6 +565,37 @@ fa_dir_t* fa_opendir(fa_archive_t* archive, const char* dir);
  */
 int fa_readdir(fa_dir_t* dir, fa_dirinfo_t* dirinfo);
 
+/*!
+ *
+ * \brief Enumerate several directory entries at once
+ *
+ * Continues the same enumeration as fa_readdir(); subdirectories come first, followed by files.
+ *
+ * \param dir Directory currently being enumerated
+ * \param dirinfo Array of directory information structures that data should be stored into
+ * \param max Number of structures in the array
+ *
+ * \return Number of entries enumerated; 0 when the enumeration is complete
+ *
+ */
+size_t fa_readdir_batch(fa_dir_t* dir, fa_dirinfo_t* dirinfo, size_t max);
+
+/*!
+ *
+ * \brief Access all file entries of a directory in place
+ *
+ * Returns pointers straight into the TOC instead of copying each entry. The current fa_readdir() position is not affected.
+ *
+ * \param dir Directory to access
+ * \param entries Structure receiving the entries
+ *
+ * \return 0 if operation was successful, <0 otherwise
+ *
+ * \note Entry names are found at ((const char*)entries->toc) + entry->name, unless the name is FA_INVALID_OFFSET
+ *
+ */
+int fa_dir_entries(fa_dir_t* dir, fa_direntries_t* entries);
+
 /*!
  *
  * \brief Complete enumeration of directory
@@ -273,6 +607,44 @@ int fa_readdir(fa_dir_t* dir, fa_dirinfo_t* dirinfo);
  */
 int fa_closedir(fa_dir_t* dir);
 
+/*!
+ *
+ * \brief Visit every file and directory below a directory
+ *
+ * The walk is depth first; each directory is reported before its files, which are reported before its subdirectories. Paths are built in a single buffer that is reused for the whole walk.
+ *
+ * \param archive Archive to enumerate in
+ * \param prefix Directory to start in (as for fa_opendir()); NULL or "" walks the whole archive
+ * \param callback Function to call for each entry
+ * \param userdata User data passed on to the callback
+ *
+ * \return 0 if the walk completed or was stopped by the callback, <0 otherwise
+ *
+ * \note Enumerating when writing is not supported
+ *
+ */
+int fa_walk(fa_archive_t* archive, const char* prefix, fa_walk_callback_t callback, void* userdata);
+
+/*!
+ *
+ * \brief Visit every file matching a pattern
+ *
+ * The pattern is matched one directory at a time; '*' matches any run of characters within a name and '?' matches a single character.
+ * A "**" component matches any number of directories, a trailing '/' matches every file below that directory, and a pattern without
+ * any '/' matches file names at any depth. Only directories that can still match are descended into.
+ *
+ * \param archive Archive to search in
+ * \param pattern Pattern to match, for example "textures/ui/", "*.shader" or "levels/level??/map*"
+ * \param callback Function to call for each matching file
+ * \param userdata User data passed on to the callback
+ *
+ * \return 0 if the query completed or was stopped by the callback, <0 otherwise
+ *
+ * \note Querying when writing is not supported
+ *
+ */
+int fa_query(fa_archive_t* archive, const char* pattern, fa_walk_callback_t callback, void* userdata);
+
 /*!
  * \}
  */
@@ -283,6 +655,12 @@ int fa_closedir(fa_dir_t* dir);
 
 #if defined(__cplusplus)
 }
+
+/*! Combine an access mode with mode flags, keeping the result a fa_mode_t */
+inline fa_mode_t operator|(fa_mode_t a, fa_mode_t b)
+{
+	return (fa_mode_t)((int)a | (int)b);
+}
 #endif
 
 #endif
@@ -44,9 +44,13 @@ typedef int int32_t;
 typedef struct fa_container_t fa_container_t;
 typedef struct fa_entry_t fa_entry_t;
 typedef struct fa_block_t fa_block_t;
+typedef struct fa_block_ex_t fa_block_ex_t;
 typedef struct fa_header_t fa_header_t;
 typedef struct fa_footer_t fa_footer_t;
 typedef struct fa_hash_t fa_hash_t;
+typedef struct fa_section_t fa_section_t;
+typedef struct fa_path_slot_t fa_path_slot_t;
+typedef struct fa_container_index_t fa_container_index_t;
 
 typedef uint32_t fa_offset_t;
 
@@ -56,15 +60,20 @@ typedef enum
 	FA_COMPRESSION_NONE = (0), /*!< No compression */
 	FA_COMPRESSION_FASTLZ = (('F' << 24) | ('L' << 16) | ('Z' << 8) | ('0')), /*!< FastLZ compression */
 	FA_COMPRESSION_DEFLATE = (('Z' << 24) | ('L' << 16) | ('D' << 8) | ('F')), /*!< Deflate compression (zlib) */
-	FA_COMPRESSION_LZMA2 = (('L' << 24) | ('Z' << 16) | ('M' << 8) | ('2'))
+	FA_COMPRESSION_LZMA2 = (('L' << 24) | ('Z' << 16) | ('M' << 8) | ('2')),
+	FA_COMPRESSION_ZSTD = (('Z' << 24) | ('S' << 16) | ('T' << 8) | ('D')), /*!< Zstandard compression, using the archive dictionary (FA_SECTION_DICTIONARY) when present */
+	FA_COMPRESSION_LZ4 = (('L' << 24) | ('Z' << 16) | ('4' << 8) | ('0')), /*!< LZ4 compression, fast mode */
+	FA_COMPRESSION_LZ4HC = (('L' << 24) | ('Z' << 16) | ('4' << 8) | ('H')) /*!< LZ4 compression, high compression mode; slower to compress, decodes as fast as FA_COMPRESSION_LZ4 */
 } fa_compression_t;
 
 /*! Version enumeration */
 typedef enum
 {
 	FA_VERSION_1 = 1,
+	FA_VERSION_2 = 2, /*!< Adds optional TOC sections (fa_header_t.sections) */
+	FA_VERSION_3 = 3, /*!< Entry data blocks use fa_block_ex_t headers, allowing fa_entry_t.blockSize above FA_BLOCK_SIZE_DEFAULT. Only written when the archive uses such a block size */
 
-	FA_VERSION_CURRENT = FA_VERSION_1
+	FA_VERSION_CURRENT = FA_VERSION_3
 } fa_version_t;
 
 /*! Cookie pattern */
@@ -74,6 +83,21 @@ typedef enum
 	FA_MAGIC_COOKIE_FOOTER = (('F' << 24)|('A' << 16)|('R' << 8)|('F')) /*!< Magic cookie used in the fa_footer_t.cookie member */ 
 } fa_magic_cookie_t;
 
+/*!
+ * \brief Optional TOC section types
+ *
+ * Readers ignore sections they do not know about, so new sections can be added without breaking existing archives.
+ */
+typedef enum
+{
+	FA_SECTION_BLOCKS = (('B' << 24) | ('L' << 16) | ('K' << 8) | ('I')), /*!< Block index; one uint32_t per entry holding the index of its first block offset (FA_INVALID_OFFSET if not indexed), followed by the block offsets (uint32_t, relative to start of entry data) for all indexed entries. Entries are split into blocks of fa_entry_t.blockSize uncompressed bytes */
+	FA_SECTION_PATHS = (('P' << 24) | ('H' << 16) | ('S' << 8) | ('H')), /*!< Path hash table; a power-of-two number of fa_path_slot_t, keyed by the full path of each named entry and probed linearly from (hash & (count - 1)) */
+	FA_SECTION_HASHES = (('H' << 24) | ('S' << 16) | ('H' << 8) | ('I')), /*!< Content hash index; one uint32_t entry index per entry, ordered by content hash (bytewise) and then by entry index */
+	FA_SECTION_BLOOM = (('B' << 24) | ('L' << 16) | ('M' << 8) | ('F')), /*!< Bloom filter over entry paths and content hashes; a power-of-two number of 512-bit blocks (16 uint32_t each). A key (h1, h2) selects block (h1 & (count - 1)) and sets FA_BLOOM_PROBES bits ((h2 + i * ((h2 >> 16) | 1)) & 511) in it. Paths use h1 = FNV-1a of the path and h2 = h1 passed through the MurmurHash3 finalizer; content hashes use the first two little-endian words of the hash */
+	FA_SECTION_CHILDREN = (('C' << 24) | ('H' << 16) | ('L' << 8) | ('D')), /*!< Container index; one fa_container_index_t per container. Child containers are stored contiguously and sorted by name (bytewise), so they can be binary searched */
+	FA_SECTION_DICTIONARY = (('D' << 24) | ('I' << 16) | ('C' << 8) | ('T')) /*!< Compression dictionary; a Zstandard dictionary shared by all FA_COMPRESSION_ZSTD blocks in the archive. Never used for the TOC itself */
+} fa_section_type_t;
+
 /*! Archive entry container */
 struct fa_container_t
 {
@@ -118,6 +142,46 @@ struct fa_block_t
 	uint16_t compressed; 		/*!< Size of the compressed block in the stream; if the highest bit is set (FILEARCHIVE_COMPRESSION_SIZE_IGNORE), the block is not compressed */
 };
 
+/*!
+ * \brief Compression block header with 32-bit sizes
+ *
+ * Replaces fa_block_t for entry data in FA_VERSION_3 archives. The TOC is always stored using fa_block_t.
+ *
+*/
+struct fa_block_ex_t
+{
+	uint32_t original;		/*!< Size of the original block when decompressed */
+	uint32_t compressed;		/*!< Size of the compressed block in the stream; if the highest bit is set (FA_COMPRESSION_SIZE_IGNORE_EX), the block is not compressed */
+};
+
+/*! Optional TOC section descriptor */
+struct fa_section_t
+{
+	uint32_t type;			/*!< Section type (fa_section_type_t) */
+	fa_offset_t offset;		/*!< Offset to section data (relative to start of TOC) */
+	uint32_t size;			/*!< Size of section data */
+};
+
+/*!
+ * \brief Path hash table slot (FA_SECTION_PATHS)
+ *
+ * The hash is 32-bit FNV-1a over the full path as written to the archive ('/' separated, no leading separator).
+ */
+struct fa_path_slot_t
+{
+	uint32_t hash;			/*!< Path hash */
+	uint32_t entry;			/*!< Index of entry (FA_INVALID_OFFSET if slot is empty) */
+	fa_offset_t container;		/*!< Offset to container holding the entry (relative to start of TOC) */
+};
+
+/*! Container index entry (FA_SECTION_CHILDREN) */
+struct fa_container_index_t
+{
+	uint32_t children;		/*!< Index of first child container */
+	uint32_t count;			/*!< Number of child containers */
+	uint32_t length;		/*!< Length of container name */
+};
+
 /*! Content hash */
 struct fa_hash_t
 {
@@ -152,6 +216,14 @@ struct fa_header_t
 	} entries; /*!< Entry information for archive */
 
 	fa_offset_t hashes;		/*!< Offset to content hashes (relative to start of TOC) */
+
+	// Version 2
+
+	struct
+	{
+		fa_offset_t offset;	/*!< Offset to section descriptors (relative to start of TOC) */
+		uint32_t count;		/*!< Number of sections in archive */
+	} sections; /*!< Optional sections in archive */
 };
 
 /*!
@@ -179,8 +251,14 @@ struct fa_footer_t
 };
 
 #define FA_COMPRESSION_SIZE_IGNORE (0x8000) /*!< Compression disable bit for compressed data blocks */ 
+#define FA_COMPRESSION_SIZE_IGNORE_EX (0x80000000) /*!< Compression disable bit for compressed data blocks using fa_block_ex_t */
+
+#define FA_BLOCK_SIZE_DEFAULT (16384) /*!< Block size of FA_VERSION_1 and FA_VERSION_2 archives, and the default when writing */
+#define FA_BLOCK_SIZE_MAX (1024 * 1024) /*!< Largest supported fa_entry_t.blockSize */
 
 #define FA_INVALID_OFFSET (0xffffffff) /*!< Any offset matching this define is not referencing any data and should be considered a NULL pointer */
 
+#define FA_BLOOM_PROBES (6) /*!< Number of bits set per key in FA_SECTION_BLOOM */
+
 #endif
 
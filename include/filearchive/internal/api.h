@@ -31,9 +31,17 @@ typedef struct fa_writer_entry_t fa_writer_entry_t;
 typedef struct fa_file_t fa_file_t;
 typedef struct fa_file_writer_t fa_file_writer_t;
 typedef struct fa_dir_t fa_dir_t;
-
-typedef struct fa_io_ops_t fa_io_ops_t;
-typedef void* fa_io_handle_t;
+typedef struct fa_async_t fa_async_t;
+typedef struct fa_async_request_t fa_async_request_t;
+typedef struct fa_cache_window_t fa_cache_window_t;
+typedef struct fa_block_cache_t fa_block_cache_t;
+typedef struct fa_dictionary_t fa_dictionary_t;
+typedef struct fa_codec_t fa_codec_t;
+typedef struct fa_io_mapping_t fa_io_mapping_t;
+typedef struct fa_mutex_t fa_mutex_t;
+typedef struct fa_cond_t fa_cond_t;
+typedef struct fa_thread_t fa_thread_t;
+typedef struct fa_stream_t fa_stream_t;
 
 #include "../api.h"
 
@@ -41,31 +49,95 @@ typedef void* fa_io_handle_t;
 
 #include <stdint.h>
 
-#define FA_COMPRESSION_MAX_BLOCK (16384)
+#define FA_COMPRESSION_MAX_BLOCK (FA_BLOCK_SIZE_DEFAULT)
 #define FA_ARCHIVE_CACHE_SIZE (FA_COMPRESSION_MAX_BLOCK * 4)
+#define FA_ARCHIVE_CACHE_WINDOWS (4)
+#define FA_ARCHIVE_POOL_SIZE (16)
+
+#define FA_ARCHIVE_FLAG_MAPPED_TOC (1 << 0)
+#define FA_ARCHIVE_FLAG_CONCURRENT (1 << 1)
 
-#if defined(_WIN32)
-#define FA_IO_INVALID_HANDLE ((fa_io_handle_t)-1)
-#else
-#define FA_IO_INVALID_HANDLE (NULL)
+#define FA_TOC_MAX_SECTIONS (8)
+
+#if defined(__unix__) || defined(__APPLE__) || defined(_WIN32)
+#define FA_THREAD_SUPPORT // platform has threads; otherwise locks are no-ops and no threads can be started
 #endif
 
+struct fa_cache_window_t
+{
+	uint32_t offset;
+	uint32_t fill;
+	uint8_t* data;
+	fa_file_t* owner;
+	uint32_t used;
+};
+
 struct fa_archive_t
 {
 	fa_header_t* toc;
 	fa_mode_t mode;
+	uint32_t flags;
 
 	const fa_io_ops_t* ops;
 	fa_io_handle_t handle;
 	uint64_t base;
 
+	uint32_t blockSize; // largest block size of any entry
+	uint32_t blockHeader; // size of entry block headers (fa_block_t or fa_block_ex_t)
+
 	struct
 	{
-		uint32_t offset;
-		uint32_t fill;
 		uint8_t* data;
-		fa_file_t* owner;
+		uint32_t size; // capacity of each window
+		uint32_t clock;
+		fa_cache_window_t windows[FA_ARCHIVE_CACHE_WINDOWS];
 	} cache;
+
+	fa_async_t* async;
+	fa_block_cache_t* blockCache;
+	fa_dictionary_t* dictionary;
+
+	struct
+	{
+		const uint32_t* first;
+		const uint32_t* offsets;
+		uint32_t count;
+	} blocks;
+
+	struct
+	{
+		const fa_path_slot_t* slots;
+		uint32_t mask;
+	} paths;
+
+	const uint32_t* hashes;
+
+	struct
+	{
+		const uint32_t* blocks;
+		uint32_t mask;
+	} bloom;
+
+	const fa_container_index_t* children;
+
+	struct
+	{
+		fa_mutex_t* mutex;
+
+		fa_file_t* files[FA_ARCHIVE_POOL_SIZE];
+		uint32_t fileCount;
+
+		fa_dir_t* dirs[FA_ARCHIVE_POOL_SIZE];
+		uint32_t dirCount;
+	} pool;
+
+	struct
+	{
+		fa_mutex_t* mutex;
+
+		fa_codec_t* free[FA_ARCHIVE_POOL_SIZE];
+		uint32_t count;
+	} codecs;
 };
 
 struct fa_archive_writer_t
@@ -73,6 +145,21 @@ struct fa_archive_writer_t
 	fa_archive_t archive;
 
 	uint32_t alignment;
+	fa_file_t* current;
+
+	struct
+	{
+		uint8_t* data;
+		uint32_t size;
+	} dictionary;
+
+	struct
+	{
+		uint8_t* data;
+		uint32_t size;
+	} compressed;
+
+	fa_compression_options_t options;
 
 	struct
 	{
@@ -104,6 +191,13 @@ struct fa_writer_entry_t
 	} size;
 
 	SHA1Context hash;
+
+	struct
+	{
+		uint32_t* data;
+		uint32_t count;
+		uint32_t capacity;
+	} blocks;
 };
 
 struct fa_file_t
@@ -112,6 +206,10 @@ struct fa_file_t
 	const fa_entry_t* entry;
 
 	uint64_t base;
+	fa_cache_window_t* window;
+	fa_stream_t* stream;
+	fa_async_request_t* async; // queued asynchronous read
+	fa_codec_t* codec; // codec state, acquired on first use and returned to the pool on close
 
 	struct
 	{
@@ -135,29 +233,68 @@ struct fa_file_writer_t
 
 struct fa_dir_t
 {
-	const fa_archive_t* archive;
+	fa_archive_t* archive;
 	const fa_container_t* parent;
 
 	const fa_container_t* container;
 	uint32_t index;
 };
 
-size_t fa_compress_block(fa_compression_t compression, void* out, size_t outSize, const void* in, size_t inSize);
-size_t fa_decompress_block(fa_compression_t compression, void* out, size_t outSize, const void* in, size_t inSize); 
-const fa_container_t* fa_find_container(const fa_archive_t* archive, const fa_container_t* container, const char* path);
-
-struct fa_io_ops_t
+struct fa_io_mapping_t
 {
-	fa_io_handle_t (*open)(const char* filename, fa_mode_t mode);
-	int (*close)(fa_io_handle_t handle);
-
-	size_t (*read)(fa_io_handle_t handle, void* buffer, size_t length);
-	size_t (*write)(fa_io_handle_t handle, const void* buffer, size_t length); 
-	int (*lseek)(fa_io_handle_t handle, int64_t offset, fa_seek_t whence);
-	size_t (*tell)(fa_io_handle_t handle);	
+	const uint8_t* data;
+	uint64_t size;
+	uint64_t offset;
 };
 
-const fa_io_ops_t* fa_get_default_ops(); 
+size_t fa_compress_block(fa_codec_t* codec, fa_compression_t compression, int level, const fa_dictionary_t* dictionary, void* out, size_t outSize, const void* in, size_t inSize);
+size_t fa_decompress_block(fa_codec_t* codec, fa_compression_t compression, const fa_dictionary_t* dictionary, void* out, size_t outSize, const void* in, size_t inSize);
+fa_codec_t* fa_codec_create();
+void fa_codec_destroy(fa_codec_t* codec);
+fa_dictionary_t* fa_dictionary_create(const void* data, size_t size, fa_mode_t mode, int level);
+void fa_dictionary_destroy(fa_dictionary_t* dictionary);
+const void* fa_find_section(const fa_archive_t* archive, uint32_t type, uint32_t* size);
+uint32_t fa_hash_path(const char* path);
+int fa_bloom_test_path(const fa_archive_t* archive, uint32_t hash);
+int fa_bloom_test_hash(const fa_archive_t* archive, const fa_hash_t* hash);
+void fa_entry_info(const fa_archive_t* archive, const fa_entry_t* entry, fa_dirinfo_t* info);
+const fa_container_t* fa_find_container(const fa_archive_t* archive, const fa_container_t* container, const char* path);
+size_t fa_decode_blocks(fa_file_t* file, const uint8_t* source, size_t sourceSize, void* buffer, size_t length);
+int fa_load_block(const fa_file_t* file, uint32_t compressed, uint32_t original, uint8_t* out, uint32_t size, uint8_t** scratch, fa_codec_t** codec, uint32_t* consumed);
+size_t fa_stream_read(fa_file_t* file, void* buffer, size_t length);
+int fa_stream_seek(fa_file_t* file, int64_t offset, fa_seek_t whence);
+void fa_stream_destroy(fa_file_t* file);
+void fa_async_destroy(fa_archive_t* archive);
+void fa_async_complete(fa_file_t* file);
+void fa_release_window(fa_file_t* file);
+
+fa_file_t* fa_alloc_file(fa_archive_t* archive);
+void fa_free_file(fa_file_t* file);
+uint8_t* fa_get_buffer(fa_file_t* file);
+fa_dir_t* fa_alloc_dir(fa_archive_t* archive);
+void fa_free_dir(fa_dir_t* dir);
+fa_codec_t* fa_acquire_codec(fa_archive_t* archive);
+void fa_release_codec(fa_archive_t* archive, fa_codec_t* codec);
+void fa_pool_destroy(fa_archive_t* archive);
+
+int fa_block_cache_read(fa_archive_t* archive, uint32_t entry, uint32_t block, void* buffer, uint32_t size, uint32_t* compressed);
+void fa_block_cache_write(fa_archive_t* archive, uint32_t entry, uint32_t block, const void* buffer, uint32_t original, uint32_t compressed);
+void fa_block_cache_destroy(fa_archive_t* archive);
+
+fa_mutex_t* fa_mutex_create();
+void fa_mutex_destroy(fa_mutex_t* mutex);
+void fa_mutex_lock(fa_mutex_t* mutex);
+void fa_mutex_unlock(fa_mutex_t* mutex);
+
+fa_cond_t* fa_cond_create();
+void fa_cond_destroy(fa_cond_t* cond);
+void fa_cond_wait(fa_cond_t* cond, fa_mutex_t* mutex);
+void fa_cond_broadcast(fa_cond_t* cond);
+
+fa_thread_t* fa_thread_create(void (*function)(void*), void* argument);
+void fa_thread_join(fa_thread_t* thread);
+
+const fa_io_ops_t* fa_get_memory_ops();
 
 #endif
 
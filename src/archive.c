@@ -24,41 +24,101 @@ SOFTWARE.
 
 #include <filearchive/internal/api.h>
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static fa_archive_t* openArchiveReading(const char* filename, fa_archiveinfo_t* info);
-static fa_archive_t* openArchiveWriting(const char* filename, uint32_t alignment);
+typedef struct fa_sorted_hash_t fa_sorted_hash_t;
+
+struct fa_sorted_hash_t
+{
+	fa_hash_t hash;
+	uint32_t entry;
+};
+
+typedef struct fa_sorted_container_t fa_sorted_container_t;
+
+struct fa_sorted_container_t
+{
+	const char* name;
+	uint32_t index;
+};
+
+static fa_archive_t* openArchiveReading(const char* filename, const fa_io_ops_t* ops, void* context, fa_archiveinfo_t* info);
+static fa_archive_t* openArchiveWriting(const char* filename, const fa_io_ops_t* ops, void* context, uint32_t alignment);
 
 static int writeToc(fa_archive_writer_t* archive, fa_compression_t compression, fa_archiveinfo_t* info);
 
 static fa_offset_t findContainer(const char* path, const fa_container_t* containers, const char* strings);
+static int compareHashes(const void* a, const void* b);
+static int compareContainers(const void* a, const void* b);
+static fa_container_index_t* sortContainers(fa_container_t* containers, uint32_t count, const char* strings);
+static uint32_t mixHash(uint32_t hash);
+static void bloomAdd(uint32_t* blocks, uint32_t mask, uint32_t h1, uint32_t h2);
+static int bloomTest(const uint32_t* blocks, uint32_t mask, uint32_t h1, uint32_t h2);
+static uint32_t readWord(const uint8_t* data);
+static int validateSections(const fa_header_t* toc, size_t tocSize);
 
 fa_archive_t* fa_open_archive(const char* filename, fa_mode_t mode, uint32_t alignment, fa_archiveinfo_t* info)
+{
+	return fa_open_archive_ex(filename, mode, alignment, info, NULL, NULL);
+}
+
+fa_archive_t* fa_open_archive_ex(const char* filename, fa_mode_t mode, uint32_t alignment, fa_archiveinfo_t* info, const fa_io_ops_t* ops, void* context)
 {
 	fa_archive_t* archive = NULL;
 
-	switch (mode)
+#if !defined(FA_THREAD_SUPPORT)
+	if (mode & FA_MODE_CONCURRENT)
+	{
+		return NULL;
+	}
+#endif
+
+	if (ops == NULL)
+	{
+		ops = (mode & FA_MODE_MAPPED) ? fa_get_mapped_ops() : fa_get_default_ops();
+	}
+
+	switch (mode & FA_MODE_MASK)
 	{
 		case FA_MODE_READ:
 		{
-			archive = openArchiveReading(filename, info);
+			archive = openArchiveReading(filename, ops, context, info);
 		}
 		break;
 
 		case FA_MODE_WRITE:
 		{
-			archive = openArchiveWriting(filename, alignment);
+			if (mode & FA_MODE_CONCURRENT)
+			{
+				break;
+			}
+
+			archive = openArchiveWriting(filename, ops, context, alignment);
 		}
 		break;
 	}
 
+	if ((archive != NULL) && (mode & FA_MODE_CONCURRENT))
+	{
+		archive->flags |= FA_ARCHIVE_FLAG_CONCURRENT;
+
+		archive->pool.mutex = fa_mutex_create();
+		if (archive->pool.mutex == NULL)
+		{
+			fa_close_archive(archive, FA_COMPRESSION_NONE, NULL);
+			return NULL;
+		}
+	}
+
 	return archive;
 }
 
 int fa_close_archive(fa_archive_t* archive, fa_compression_t compression, fa_archiveinfo_t* info)
 {
+	uint32_t i;
 	int result = 0;
 
 	if (archive == NULL)
@@ -74,37 +134,162 @@ int fa_close_archive(fa_archive_t* archive, fa_compression_t compression, fa_arc
 			result = -1;
 		}
 
+		for (i = 0; i < writer->entries.count; ++i)
+		{
+			free(writer->entries.data[i].path);
+			free(writer->entries.data[i].blocks.data);
+		}
+
 		free(writer->entries.data);
+		free(writer->dictionary.data);
+		free(writer->compressed.data);
+	}
+
+	fa_async_destroy(archive);
+	fa_block_cache_destroy(archive);
+	fa_dictionary_destroy(archive->dictionary);
+	fa_pool_destroy(archive);
+
+	for (i = 0; i < FA_ARCHIVE_CACHE_WINDOWS; ++i)
+	{
+		free(archive->cache.windows[i].data);
 	}
 
 	archive->ops->close(archive->handle);
 
-	free(archive->toc);
+	if (!(archive->flags & FA_ARCHIVE_FLAG_MAPPED_TOC))
+	{
+		free(archive->toc);
+	}
 	free(archive);
 
 	return result;
 }
 
-static fa_archive_t* openArchiveReading(const char* filename, fa_archiveinfo_t* info)
+int fa_set_block_size(fa_archive_t* archive, uint32_t size)
+{
+	fa_archive_writer_t* writer = (fa_archive_writer_t*)archive;
+
+	if ((archive == NULL) || (archive->mode != FA_MODE_WRITE) || (writer->entries.count > 0) || (size < FA_BLOCK_SIZE_DEFAULT) || (size > FA_BLOCK_SIZE_MAX) || (size & (size - 1)))
+	{
+		return -1;
+	}
+
+	// compressors may expand incompressible data, so reserve twice the block size for their output
+
+	if ((size * 2) > archive->cache.size)
+	{
+		uint8_t* compressed = realloc(writer->compressed.data, size * 2);
+		if (compressed == NULL)
+		{
+			return -1;
+		}
+
+		writer->compressed.data = compressed;
+		writer->compressed.size = size * 2;
+	}
+
+	archive->blockSize = size;
+	archive->blockHeader = size > FA_BLOCK_SIZE_DEFAULT ? sizeof(fa_block_ex_t) : sizeof(fa_block_t);
+
+	return 0;
+}
+
+fa_archive_t* fa_open_archive_memory(const void* data, size_t size, fa_archiveinfo_t* info)
+{
+	fa_io_mapping_t memory;
+
+	memory.data = (const uint8_t*)data;
+	memory.size = size;
+	memory.offset = 0;
+
+	return openArchiveReading(NULL, fa_get_memory_ops(), &memory, info);
+}
+
+const void* fa_find_section(const fa_archive_t* archive, uint32_t type, uint32_t* size)
+{
+	const fa_section_t* sections;
+	uint32_t i;
+
+	if (archive->toc->version < FA_VERSION_2)
+	{
+		return NULL;
+	}
+
+	sections = (const fa_section_t*)(((const uint8_t*)archive->toc) + archive->toc->sections.offset);
+	for (i = 0; i < archive->toc->sections.count; ++i)
+	{
+		if (sections[i].type == type)
+		{
+			if (size)
+			{
+				*size = sections[i].size;
+			}
+			return ((const uint8_t*)archive->toc) + sections[i].offset;
+		}
+	}
+
+	return NULL;
+}
+
+uint32_t fa_hash_path(const char* path)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	while (*path != '\0')
+	{
+		hash = (hash ^ (uint8_t)*path++) * 0x01000193;
+	}
+
+	return hash;
+}
+
+int fa_bloom_test_path(const fa_archive_t* archive, uint32_t hash)
+{
+	if (archive->bloom.blocks == NULL)
+	{
+		return 1;
+	}
+
+	return bloomTest(archive->bloom.blocks, archive->bloom.mask, hash, mixHash(hash));
+}
+
+int fa_bloom_test_hash(const fa_archive_t* archive, const fa_hash_t* hash)
+{
+	if (archive->bloom.blocks == NULL)
+	{
+		return 1;
+	}
+
+	return bloomTest(archive->bloom.blocks, archive->bloom.mask, readWord(hash->data), readWord(hash->data + 4));
+}
+
+static fa_archive_t* openArchiveReading(const char* filename, const fa_io_ops_t* ops, void* context, fa_archiveinfo_t* info)
 {
 	fa_archive_t* archive = malloc(sizeof(fa_archive_t) + FA_ARCHIVE_CACHE_SIZE);
 	memset(archive, 0, sizeof(fa_archive_t));
 
-	archive->ops = fa_get_default_ops();
+	archive->ops = ops;
 
 	archive->mode = FA_MODE_READ;
 	archive->cache.data = (uint8_t*)(archive + 1);
+	archive->cache.size = FA_ARCHIVE_CACHE_SIZE;
 
 	do
 	{
 		size_t maxRead;
 		long fileSize;
+		uint64_t tocOffset;
+		const uint8_t* tail = NULL;
 		unsigned int i, j;
+		uint32_t size = 0;
 		fa_footer_t footer;
 		SHA1Context state;
 		fa_hash_t hash;
+		const void* dictionary;
+		const fa_entry_t* entries;
 
-		archive->handle = archive->ops->open(filename, FA_MODE_READ);
+		archive->handle = archive->ops->open(filename, FA_MODE_READ, context);
 		if (archive->handle == FA_IO_INVALID_HANDLE)
 		{
 			break;
@@ -122,25 +307,35 @@ static fa_archive_t* openArchiveReading(const char* filename, fa_archiveinfo_t*
 		}
 
 		maxRead = fileSize > FA_ARCHIVE_CACHE_SIZE ? FA_ARCHIVE_CACHE_SIZE : fileSize;
-		if ((maxRead < sizeof(footer)) || (archive->ops->lseek(archive->handle, -maxRead, FA_SEEK_CURR) < 0))
+		if (maxRead < sizeof(footer))
 		{
 			break;
 		}
 
-		if (archive->ops->read(archive->handle, archive->cache.data, maxRead) != maxRead)
+		if (archive->ops->map != NULL)
 		{
-			break;
+			tail = archive->ops->map(archive->handle, fileSize - maxRead, maxRead);
+		}
+
+		if (tail == NULL)
+		{
+			if (archive->ops->pread(archive->handle, archive->cache.data, maxRead, fileSize - maxRead) != maxRead)
+			{
+				break;
+			}
+
+			tail = archive->cache.data;
 		}
 
 		memset(&footer, 0, sizeof(footer));
 		for (i = maxRead - sizeof(footer); i > 0; --i)
 		{
 			uint32_t cookie;
-			memcpy(&cookie, archive->cache.data + i, sizeof(cookie));
+			memcpy(&cookie, tail + i, sizeof(cookie));
 
 			if (cookie == FA_MAGIC_COOKIE_FOOTER)
 			{
-				memcpy(&footer, archive->cache.data + i, sizeof(footer));
+				memcpy(&footer, tail + i, sizeof(footer));
 				break;
 			}
 		}
@@ -151,19 +346,27 @@ static fa_archive_t* openArchiveReading(const char* filename, fa_archiveinfo_t*
 		}
 
 		archive->base = fileSize - (maxRead - i) - (footer.toc.compressed + footer.data.compressed);
+		tocOffset = fileSize - (maxRead - i) - footer.toc.compressed;
 
-		if (archive->ops->lseek(archive->handle, fileSize - (maxRead - i) - footer.toc.compressed, FA_SEEK_SET) < 0)
+		if (footer.toc.compression == FA_COMPRESSION_NONE)
 		{
-			break;
-		}
+			const void* mapped = archive->ops->map != NULL ? archive->ops->map(archive->handle, tocOffset, footer.toc.original) : NULL;
 
-		archive->toc = malloc(footer.toc.original);
+			// use the TOC in place when it is suitably aligned
 
-		if (footer.toc.compression == FA_COMPRESSION_NONE)
-		{
-			if (archive->ops->read(archive->handle, archive->toc, footer.toc.original) != footer.toc.original)
+			if ((mapped != NULL) && !(((uintptr_t)mapped) & (sizeof(uint32_t) - 1)))
 			{
-				break;
+				archive->toc = (fa_header_t*)mapped;
+				archive->flags |= FA_ARCHIVE_FLAG_MAPPED_TOC;
+			}
+			else
+			{
+				archive->toc = malloc(footer.toc.original);
+
+				if (archive->ops->pread(archive->handle, archive->toc, footer.toc.original, tocOffset) != footer.toc.original)
+				{
+					break;
+				}
 			}
 		}
 		else
@@ -172,16 +375,19 @@ static fa_archive_t* openArchiveReading(const char* filename, fa_archiveinfo_t*
 			uint32_t written = 0;
 			uint32_t cacheSize = 0;
 
+			archive->toc = malloc(footer.toc.original);
+
 			while ((length > 0) && (written < footer.toc.original))
 			{
 				uint32_t maxRead = length > (FA_ARCHIVE_CACHE_SIZE - cacheSize) ? (FA_ARCHIVE_CACHE_SIZE - cacheSize) : length;
 				uint32_t cacheOffset = 0;
 
-				if (archive->ops->read(archive->handle, archive->cache.data + cacheSize, maxRead) != maxRead)
+				if (archive->ops->pread(archive->handle, archive->cache.data + cacheSize, maxRead, tocOffset) != maxRead)
 				{
 					break;
 				}
 
+				tocOffset += maxRead;
 				cacheSize += maxRead;
 
 				while (cacheOffset < cacheSize)
@@ -213,7 +419,7 @@ static fa_archive_t* openArchiveReading(const char* filename, fa_archiveinfo_t*
 					}
 					else
 					{
-						if (fa_decompress_block(footer.toc.compression, ((uint8_t*)archive->toc) + written, block.original, archive->cache.data + cacheOffset + sizeof(block), block.compressed) != block.original)
+						if (fa_decompress_block(NULL, footer.toc.compression, NULL, ((uint8_t*)archive->toc) + written, block.original, archive->cache.data + cacheOffset + sizeof(block), block.compressed) != block.original)
 						{
 							length = 0;
 							break;
@@ -226,9 +432,9 @@ static fa_archive_t* openArchiveReading(const char* filename, fa_archiveinfo_t*
 
 				if ((cacheSize - cacheOffset) > 0)
 				{
-					memcpy(archive->cache.data, archive->cache.data + cacheOffset, (cacheSize - cacheOffset));
-					cacheSize -= cacheOffset;
+					memmove(archive->cache.data, archive->cache.data + cacheOffset, (cacheSize - cacheOffset));
 				}
+				cacheSize -= cacheOffset;
 
 				length -= maxRead;
 			}
@@ -262,10 +468,136 @@ static fa_archive_t* openArchiveReading(const char* filename, fa_archiveinfo_t*
 			break;
 		}
 
+		if (validateSections(archive->toc, footer.toc.original))
+		{
+			break;
+		}
+
+		archive->blockSize = FA_COMPRESSION_MAX_BLOCK;
+		archive->blockHeader = sizeof(fa_block_t);
+
+		entries = (const fa_entry_t*)(((const uint8_t*)archive->toc) + archive->toc->entries.offset);
+
+		for (i = 0; i < archive->toc->entries.count; ++i)
+		{
+			if (entries[i].compression == FA_COMPRESSION_NONE)
+			{
+				continue;
+			}
+
+			// earlier versions always wrote the default block size; block sizes are otherwise powers of two between the default and maximum, which block offsets and buffer sizes rely on
+
+			if (archive->toc->version < FA_VERSION_3)
+			{
+				if (entries[i].blockSize != FA_BLOCK_SIZE_DEFAULT)
+				{
+					break;
+				}
+
+				continue;
+			}
+
+			if ((entries[i].blockSize < FA_BLOCK_SIZE_DEFAULT) || (entries[i].blockSize > FA_BLOCK_SIZE_MAX) || (entries[i].blockSize & (entries[i].blockSize - 1)))
+			{
+				break;
+			}
+
+			archive->blockSize = entries[i].blockSize > archive->blockSize ? entries[i].blockSize : archive->blockSize;
+		}
+
+		if (i != archive->toc->entries.count)
+		{
+			break;
+		}
+
+		if (archive->toc->version >= FA_VERSION_3)
+		{
+			archive->blockHeader = sizeof(fa_block_ex_t);
+		}
+
+		// read windows must hold at least one complete compressed block
+
+		if ((archive->blockSize + archive->blockHeader) > archive->cache.size)
+		{
+			archive->cache.size = archive->blockSize + archive->blockHeader;
+		}
+
+		archive->blocks.first = fa_find_section(archive, FA_SECTION_BLOCKS, &size);
+		if ((archive->blocks.first != NULL) && (size >= archive->toc->entries.count * sizeof(uint32_t)))
+		{
+			archive->blocks.offsets = archive->blocks.first + archive->toc->entries.count;
+			archive->blocks.count = size / sizeof(uint32_t) - archive->toc->entries.count;
+		}
+		else
+		{
+			archive->blocks.first = NULL;
+		}
+
+		archive->paths.slots = fa_find_section(archive, FA_SECTION_PATHS, &size);
+		if ((archive->paths.slots != NULL) && (size >= sizeof(fa_path_slot_t)) && !(size % sizeof(fa_path_slot_t)) && !((size / sizeof(fa_path_slot_t)) & ((size / sizeof(fa_path_slot_t)) - 1)))
+		{
+			archive->paths.mask = size / sizeof(fa_path_slot_t) - 1;
+		}
+		else
+		{
+			archive->paths.slots = NULL;
+		}
+
+		archive->hashes = fa_find_section(archive, FA_SECTION_HASHES, &size);
+		if ((archive->hashes != NULL) && (size != archive->toc->entries.count * sizeof(uint32_t)))
+		{
+			archive->hashes = NULL;
+		}
+
+		archive->bloom.blocks = fa_find_section(archive, FA_SECTION_BLOOM, &size);
+		if ((archive->bloom.blocks != NULL) && (size >= 16 * sizeof(uint32_t)) && !(size % (16 * sizeof(uint32_t))) && !((size / (16 * sizeof(uint32_t))) & ((size / (16 * sizeof(uint32_t))) - 1)))
+		{
+			archive->bloom.mask = size / (16 * sizeof(uint32_t)) - 1;
+		}
+		else
+		{
+			archive->bloom.blocks = NULL;
+		}
+
+		archive->children = fa_find_section(archive, FA_SECTION_CHILDREN, &size);
+		if ((archive->children != NULL) && (size != archive->toc->containers.count * sizeof(fa_container_index_t)))
+		{
+			archive->children = NULL;
+		}
+
+		// a dictionary that cannot be used only affects FA_COMPRESSION_ZSTD files, which will then fail to decode
+
+		dictionary = fa_find_section(archive, FA_SECTION_DICTIONARY, &size);
+		if ((dictionary != NULL) && (size > 0))
+		{
+			archive->dictionary = fa_dictionary_create(dictionary, size, FA_MODE_READ, FA_COMPRESSION_LEVEL_DEFAULT);
+		}
+
+		archive->codecs.mutex = fa_mutex_create();
+		if (archive->codecs.mutex == NULL)
+		{
+			fa_dictionary_destroy(archive->dictionary);
+			break;
+		}
+
 		if (info)
 		{
-			info->header = *archive->toc;
 			info->footer = footer;
+
+			// version 1 headers end before the sections field, so only that prefix is present in the TOC
+
+			if (archive->toc->version < FA_VERSION_2)
+			{
+				memset(&(info->header), 0, sizeof(fa_header_t));
+				memcpy(&(info->header), archive->toc, offsetof(fa_header_t, sections));
+
+				info->header.sections.offset = FA_INVALID_OFFSET;
+				info->header.sections.count = 0;
+			}
+			else
+			{
+				info->header = *archive->toc;
+			}
 		}
 
 		return archive;
@@ -277,25 +609,32 @@ static fa_archive_t* openArchiveReading(const char* filename, fa_archiveinfo_t*
 		archive->ops->close(archive->handle);
 	}
 
-	free(archive->toc);
+	if (!(archive->flags & FA_ARCHIVE_FLAG_MAPPED_TOC))
+	{
+		free(archive->toc);
+	}
 	free(archive);
 
 	return NULL;
 }
 
-static fa_archive_t* openArchiveWriting(const char* filename, uint32_t alignment)
+static fa_archive_t* openArchiveWriting(const char* filename, const fa_io_ops_t* ops, void* context, uint32_t alignment)
 {
 	fa_archive_writer_t* writer = malloc(sizeof(fa_archive_writer_t) + FA_ARCHIVE_CACHE_SIZE);
 	memset(writer, 0, sizeof(fa_archive_writer_t));
 
-	writer->archive.ops = fa_get_default_ops();
+	writer->archive.ops = ops;
 
 	writer->archive.mode = FA_MODE_WRITE;
 	writer->archive.cache.data = (uint8_t*)(writer + 1);
+	writer->archive.cache.size = FA_ARCHIVE_CACHE_SIZE;
+
+	writer->archive.blockSize = FA_COMPRESSION_MAX_BLOCK;
+	writer->archive.blockHeader = sizeof(fa_block_t);
 
 	do
 	{
-		writer->archive.handle = writer->archive.ops->open(filename, FA_MODE_WRITE);
+		writer->archive.handle = writer->archive.ops->open(filename, FA_MODE_WRITE, context);
 		if (writer->archive.handle == FA_IO_INVALID_HANDLE)
 		{
 			break;
@@ -338,21 +677,41 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 		size_t capacity;
 		fa_entry_t* data;
 		fa_hash_t* hashes;
-	} entries = { 0, 1024, malloc(1024 * sizeof(fa_entry_t)), malloc(1024 * sizeof(fa_hash_t)) };
+		uint32_t* blocks;
+		const fa_writer_entry_t** sources;
+	} entries = { 0, 1024, malloc(1024 * sizeof(fa_entry_t)), malloc(1024 * sizeof(fa_hash_t)), malloc(1024 * sizeof(uint32_t)), malloc(1024 * sizeof(fa_writer_entry_t*)) };
+
+	struct
+	{
+		size_t count;
+		size_t capacity;
+		uint32_t* data;
+	} blockOffsets = { 0, 1024, malloc(1024 * sizeof(uint32_t)) };
 
+	struct
+	{
+		fa_section_t info[FA_TOC_MAX_SECTIONS];
+		void* data[FA_TOC_MAX_SECTIONS];
+		uint32_t count;
+	} sections;
+
+	fa_container_index_t* containerIndex = NULL;
 	int result = -1;
 
+	sections.count = 0;
+
 	do
 	{
 		int i, j, count;
 		fa_archiveinfo_t local;
 		SHA1Context state;
+		fa_offset_t sectionOffset;
 
 		struct
 		{
 			void* data;
 			size_t size;
-		} blocks[5]; // header, containers, entries, hashes, strings
+		} blocks[6 + FA_TOC_MAX_SECTIONS]; // header, containers, entries, hashes, strings, sections, section data
 
 		memset(&local, 0, sizeof(local));
 
@@ -432,6 +791,14 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 			}
 		}
 
+		// store the children of each container contiguously, sorted by name
+
+		containerIndex = sortContainers(containers.data, containers.count, strings.data);
+		if (containerIndex == NULL)
+		{
+			break;
+		}
+
 		// construct entries
 
 		for (i = 0, count = writer->entries.count; i < count; ++i)
@@ -490,10 +857,32 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 					entries.capacity *= 2;
 					entries.data = realloc(entries.data, entries.capacity * sizeof(fa_entry_t));
 					entries.hashes = realloc(entries.hashes, entries.capacity * sizeof(fa_hash_t));
+					entries.blocks = realloc(entries.blocks, entries.capacity * sizeof(uint32_t));
+					entries.sources = realloc(entries.sources, entries.capacity * sizeof(fa_writer_entry_t*));
 				}
 
 				entry = &(entries.data[entries.count]);
 				hash = &(entries.hashes[entries.count]);
+
+				if ((writerEntry->compression != FA_COMPRESSION_NONE) && (writerEntry->blocks.count > 0))
+				{
+					while ((blockOffsets.count + writerEntry->blocks.count) > blockOffsets.capacity)
+					{
+						blockOffsets.capacity *= 2;
+						blockOffsets.data = realloc(blockOffsets.data, blockOffsets.capacity * sizeof(uint32_t));
+					}
+
+					entries.blocks[entries.count] = blockOffsets.count;
+
+					memcpy(blockOffsets.data + blockOffsets.count, writerEntry->blocks.data, writerEntry->blocks.count * sizeof(uint32_t));
+					blockOffsets.count += writerEntry->blocks.count;
+				}
+				else
+				{
+					entries.blocks[entries.count] = FA_INVALID_OFFSET;
+				}
+
+				entries.sources[entries.count] = writerEntry;
 				++ entries.count;
 
 				entry->data = writerEntry->offset;
@@ -516,7 +905,7 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 				}
 
 				entry->compression = writerEntry->compression;
-				entry->blockSize = FA_COMPRESSION_MAX_BLOCK;
+				entry->blockSize = writer->archive.blockSize;
 
 				entry->size.original = writerEntry->size.original;
 				entry->size.compressed = writerEntry->size.compressed;
@@ -558,11 +947,183 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 			entry->name = relocateOffset(entry->name, sizeof(fa_header_t) + containers.count * sizeof(fa_container_t) + entries.count * (sizeof(fa_entry_t) + sizeof(fa_hash_t)));
 		}
 
+		// construct sections, aligned after the string table
+
+		while (strings.count & (sizeof(uint32_t) - 1))
+		{
+			if (strings.count == strings.capacity)
+			{
+				strings.capacity *= 2;
+				strings.data = realloc(strings.data, strings.capacity);
+			}
+
+			strings.data[strings.count++] = '\0';
+		}
+
+		if (blockOffsets.count > 0)
+		{
+			fa_section_t* section = &(sections.info[sections.count]);
+			uint8_t* data;
+
+			section->type = FA_SECTION_BLOCKS;
+			section->size = (entries.count + blockOffsets.count) * sizeof(uint32_t);
+
+			data = malloc(section->size);
+			memcpy(data, entries.blocks, entries.count * sizeof(uint32_t));
+			memcpy(data + entries.count * sizeof(uint32_t), blockOffsets.data, blockOffsets.count * sizeof(uint32_t));
+
+			sections.data[sections.count++] = data;
+		}
+
+		if (entries.count > 0)
+		{
+			fa_section_t* section = &(sections.info[sections.count]);
+			fa_path_slot_t* slots;
+			uint32_t slotCount = 16;
+
+			// keep the table at most half full so probe sequences stay short
+
+			while (slotCount < entries.count * 2)
+			{
+				slotCount <<= 1;
+			}
+
+			section->type = FA_SECTION_PATHS;
+			section->size = slotCount * sizeof(fa_path_slot_t);
+
+			slots = malloc(section->size);
+			for (i = 0; i < (int)slotCount; ++i)
+			{
+				slots[i].hash = 0;
+				slots[i].entry = FA_INVALID_OFFSET;
+				slots[i].container = FA_INVALID_OFFSET;
+			}
+
+			for (i = 0, count = entries.count; i < count; ++i)
+			{
+				const fa_writer_entry_t* source = entries.sources[i];
+				uint32_t hash, slot;
+
+				if (entries.data[i].name == FA_INVALID_OFFSET)
+				{
+					continue;
+				}
+
+				hash = fa_hash_path(source->path);
+				slot = hash & (slotCount - 1);
+
+				while (slots[slot].entry != FA_INVALID_OFFSET)
+				{
+					slot = (slot + 1) & (slotCount - 1);
+				}
+
+				slots[slot].hash = hash;
+				slots[slot].entry = i;
+				slots[slot].container = relocateOffset(source->container, sizeof(fa_header_t));
+			}
+
+			sections.data[sections.count++] = slots;
+		}
+
+		if (entries.count > 0)
+		{
+			fa_section_t* section = &(sections.info[sections.count]);
+			fa_sorted_hash_t* sorted = malloc(entries.count * sizeof(fa_sorted_hash_t));
+			uint32_t* order;
+
+			for (i = 0, count = entries.count; i < count; ++i)
+			{
+				sorted[i].hash = entries.hashes[i];
+				sorted[i].entry = i;
+			}
+
+			qsort(sorted, entries.count, sizeof(fa_sorted_hash_t), compareHashes);
+
+			section->type = FA_SECTION_HASHES;
+			section->size = entries.count * sizeof(uint32_t);
+
+			order = malloc(section->size);
+			for (i = 0, count = entries.count; i < count; ++i)
+			{
+				order[i] = sorted[i].entry;
+			}
+
+			free(sorted);
+
+			sections.data[sections.count++] = order;
+		}
+
+		if (containers.count > 0)
+		{
+			fa_section_t* section = &(sections.info[sections.count]);
+
+			section->type = FA_SECTION_CHILDREN;
+			section->size = containers.count * sizeof(fa_container_index_t);
+
+			sections.data[sections.count++] = containerIndex;
+			containerIndex = NULL;
+		}
+
+		if (entries.count > 0)
+		{
+			fa_section_t* section = &(sections.info[sections.count]);
+			uint32_t* bloom;
+			uint32_t blockCount = 1;
+
+			// about 12 bits per key (path and content hash for every entry), giving roughly 1% false positives
+
+			while ((blockCount * 512) < (entries.count * 2 * 12))
+			{
+				blockCount <<= 1;
+			}
+
+			section->type = FA_SECTION_BLOOM;
+			section->size = blockCount * 16 * sizeof(uint32_t);
+
+			bloom = malloc(section->size);
+			memset(bloom, 0, section->size);
+
+			for (i = 0, count = entries.count; i < count; ++i)
+			{
+				const fa_hash_t* hash = &(entries.hashes[i]);
+
+				if (entries.data[i].name != FA_INVALID_OFFSET)
+				{
+					uint32_t pathHash = fa_hash_path(entries.sources[i]->path);
+					bloomAdd(bloom, blockCount - 1, pathHash, mixHash(pathHash));
+				}
+
+				bloomAdd(bloom, blockCount - 1, readWord(hash->data), readWord(hash->data + 4));
+			}
+
+			sections.data[sections.count++] = bloom;
+		}
+
+		// the dictionary has no alignment requirements, so it goes last
+
+		if (writer->dictionary.data != NULL)
+		{
+			fa_section_t* section = &(sections.info[sections.count]);
+
+			section->type = FA_SECTION_DICTIONARY;
+			section->size = writer->dictionary.size;
+
+			sections.data[sections.count++] = writer->dictionary.data;
+			writer->dictionary.data = NULL;
+		}
+
+		sectionOffset = sizeof(fa_header_t) + containers.count * sizeof(fa_container_t) + entries.count * (sizeof(fa_entry_t) + sizeof(fa_hash_t)) + strings.count;
+
+		for (i = 0, count = sections.count; i < count; ++i)
+		{
+			sections.info[i].offset = (i > 0) ? sections.info[i-1].offset + sections.info[i-1].size : sectionOffset + sections.count * sizeof(fa_section_t);
+		}
+
 		// create header
 
 		local.header.cookie = FA_MAGIC_COOKIE_HEADER;
-		local.header.version = FA_VERSION_CURRENT;
-		local.header.size = sizeof(fa_header_t) + containers.count + sizeof(fa_container_t) + entries.count * (sizeof(fa_entry_t) + sizeof(fa_hash_t)) + strings.count;
+		local.header.version = writer->archive.blockHeader == sizeof(fa_block_ex_t) ? FA_VERSION_3 : FA_VERSION_2;
+		local.header.size = sectionOffset + sections.count * sizeof(fa_section_t);
 		local.header.flags = 0;
 
 		local.header.containers.offset = sizeof(fa_header_t);
@@ -573,6 +1134,9 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 
 		local.header.hashes = sizeof(fa_header_t) + containers.count * sizeof(fa_container_t) + entries.count * sizeof(fa_entry_t);
 
+		local.header.sections.offset = sections.count > 0 ? sectionOffset : FA_INVALID_OFFSET;
+		local.header.sections.count = sections.count;
+
 		// write toc to archive
 
 		blocks[0].data = &local.header;
@@ -590,6 +1154,17 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 		blocks[4].data = strings.data;
 		blocks[4].size = strings.count;
 
+		blocks[5].data = sections.info;
+		blocks[5].size = sections.count * sizeof(fa_section_t);
+
+		for (i = 0, count = sections.count; i < count; ++i)
+		{
+			local.header.size += sections.info[i].size;
+
+			blocks[6 + i].data = sections.data[i];
+			blocks[6 + i].size = sections.info[i].size;
+		}
+
 		SHA1Reset(&state);
 
 		result = 0;
@@ -600,7 +1175,7 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 			uint8_t* compressedBlock = blockData + FA_COMPRESSION_MAX_BLOCK;
 			fa_block_t block;
 
-			for (i = 0, count = 5; (i < count) && (blockSize < FA_COMPRESSION_MAX_BLOCK); ++i)
+			for (i = 0, count = 6 + sections.count; (i < count) && (blockSize < FA_COMPRESSION_MAX_BLOCK); ++i)
 			{
 				size_t maxWrite = blocks[i].size > (FA_COMPRESSION_MAX_BLOCK - blockSize) ? (FA_COMPRESSION_MAX_BLOCK - blockSize) : blocks[i].size;
 
@@ -631,7 +1206,7 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 				continue;
 			}
 
-			compressedSize = fa_compress_block(compression, compressedBlock, FA_COMPRESSION_MAX_BLOCK * 3, blockData, blockSize);
+			compressedSize = fa_compress_block(NULL, compression, writer->options.level, NULL, compressedBlock, FA_COMPRESSION_MAX_BLOCK * 3, blockData, blockSize);
 			if (compressedSize >= blockSize)
 			{
 				block.original = blockSize;
@@ -695,9 +1270,19 @@ static int writeToc(fa_archive_writer_t* writer, fa_compression_t compression, f
 	}
 	while (0);
 
+	while (sections.count > 0)
+	{
+		free(sections.data[--sections.count]);
+	}
+
+	free(containerIndex);
 	free(strings.data);
 	free(containers.data);
 	free(entries.data);
+	free(entries.hashes);
+	free(entries.blocks);
+	free(entries.sources);
+	free(blockOffsets.data);
 
 	return result;
 }
@@ -740,3 +1325,183 @@ static fa_offset_t findContainer(const char* path, const fa_container_t* contain
 	
 	return offset;
 }
+
+static int compareHashes(const void* a, const void* b)
+{
+	const fa_sorted_hash_t* lhs = (const fa_sorted_hash_t*)a;
+	const fa_sorted_hash_t* rhs = (const fa_sorted_hash_t*)b;
+	int result = memcmp(&(lhs->hash), &(rhs->hash), sizeof(fa_hash_t));
+
+	if (result != 0)
+	{
+		return result;
+	}
+
+	return lhs->entry < rhs->entry ? -1 : (lhs->entry > rhs->entry ? 1 : 0);
+}
+
+static uint32_t mixHash(uint32_t hash)
+{
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+static void bloomAdd(uint32_t* blocks, uint32_t mask, uint32_t h1, uint32_t h2)
+{
+	uint32_t* block = blocks + (h1 & mask) * 16;
+	uint32_t step = (h2 >> 16) | 1;
+	uint32_t i;
+
+	for (i = 0; i < FA_BLOOM_PROBES; ++i, h2 += step)
+	{
+		block[(h2 & 511) >> 5] |= 1u << (h2 & 31);
+	}
+}
+
+static int bloomTest(const uint32_t* blocks, uint32_t mask, uint32_t h1, uint32_t h2)
+{
+	const uint32_t* block = blocks + (h1 & mask) * 16;
+	uint32_t step = (h2 >> 16) | 1;
+	uint32_t i;
+
+	for (i = 0; i < FA_BLOOM_PROBES; ++i, h2 += step)
+	{
+		if (!(block[(h2 & 511) >> 5] & (1u << (h2 & 31))))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static uint32_t readWord(const uint8_t* data)
+{
+	return ((uint32_t)data[0]) | (((uint32_t)data[1]) << 8) | (((uint32_t)data[2]) << 16) | (((uint32_t)data[3]) << 24);
+}
+
+static int compareContainers(const void* a, const void* b)
+{
+	return strcmp(((const fa_sorted_container_t*)a)->name, ((const fa_sorted_container_t*)b)->name);
+}
+
+static fa_container_index_t* sortContainers(fa_container_t* containers, uint32_t count, const char* strings)
+{
+	fa_container_index_t* index = malloc(count * sizeof(fa_container_index_t));
+	fa_container_t* sorted = malloc(count * sizeof(fa_container_t));
+	fa_sorted_container_t* children = malloc(count * sizeof(fa_sorted_container_t));
+	uint32_t* order = malloc(count * sizeof(uint32_t));
+	uint32_t* remap = malloc(count * sizeof(uint32_t));
+	uint32_t i, n = 1;
+
+	if ((index == NULL) || (sorted == NULL) || (children == NULL) || (order == NULL) || (remap == NULL))
+	{
+		free(remap);
+		free(order);
+		free(children);
+		free(sorted);
+		free(index);
+		return NULL;
+	}
+
+	// breadth first, appending the children of each container as one sorted run
+
+	order[0] = 0;
+	for (i = 0; i < n; ++i)
+	{
+		const fa_container_t* container = &(containers[order[i]]);
+		fa_offset_t curr;
+		uint32_t childCount = 0;
+
+		for (curr = container->children; curr != FA_INVALID_OFFSET; curr = containers[curr / sizeof(fa_container_t)].next)
+		{
+			children[childCount].name = strings + containers[curr / sizeof(fa_container_t)].name;
+			children[childCount].index = curr / sizeof(fa_container_t);
+			++ childCount;
+		}
+
+		qsort(children, childCount, sizeof(fa_sorted_container_t), compareContainers);
+
+		index[i].children = n;
+		index[i].count = childCount;
+		index[i].length = container->name != FA_INVALID_OFFSET ? strlen(strings + container->name) : 0;
+
+		while (childCount > 0)
+		{
+			order[n + childCount - 1] = children[childCount - 1].index;
+			-- childCount;
+		}
+
+		n += index[i].count;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		remap[order[i]] = i;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		const fa_container_t* container = &(containers[order[i]]);
+		fa_container_t* out = &(sorted[i]);
+		uint32_t parent = container->parent != FA_INVALID_OFFSET ? remap[container->parent / sizeof(fa_container_t)] : 0;
+
+		out->parent = container->parent != FA_INVALID_OFFSET ? parent * sizeof(fa_container_t) : FA_INVALID_OFFSET;
+		out->children = index[i].count > 0 ? index[i].children * sizeof(fa_container_t) : FA_INVALID_OFFSET;
+		out->next = (container->parent != FA_INVALID_OFFSET) && ((i + 1) < (index[parent].children + index[parent].count)) ? (i + 1) * sizeof(fa_container_t) : FA_INVALID_OFFSET;
+
+		out->name = container->name;
+		out->entries = container->entries;
+	}
+
+	memcpy(containers, sorted, count * sizeof(fa_container_t));
+
+	free(remap);
+	free(order);
+	free(children);
+	free(sorted);
+
+	return index;
+}
+
+static int validateSections(const fa_header_t* toc, size_t tocSize)
+{
+	const fa_section_t* sections;
+	uint32_t i;
+
+	if (toc->version < FA_VERSION_2)
+	{
+		return 0;
+	}
+
+	if (tocSize < sizeof(fa_header_t))
+	{
+		return -1;
+	}
+
+	if (toc->sections.count == 0)
+	{
+		return 0;
+	}
+
+	if ((toc->sections.count > (tocSize / sizeof(fa_section_t))) || (toc->sections.offset & (sizeof(uint32_t) - 1)) || (toc->sections.offset > tocSize - toc->sections.count * sizeof(fa_section_t)))
+	{
+		return -1;
+	}
+
+	sections = (const fa_section_t*)(((const uint8_t*)toc) + toc->sections.offset);
+	for (i = 0; i < toc->sections.count; ++i)
+	{
+		if ((sections[i].offset & (sizeof(uint32_t) - 1)) || (sections[i].size > tocSize) || (sections[i].offset > tocSize - sections[i].size))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,598 @@
+/*
+
+Copyright (c) 2010 Jesper Svennevid
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <filearchive/internal/api.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#pragma warning(disable: 4127)
+#endif
+
+#if defined(FA_URING_ENABLE)
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#define FA_ASYNC_QUEUE_SIZE (256)
+
+struct fa_async_request_t
+{
+	fa_async_request_t* next;
+
+	fa_file_t* file;
+	fa_read_callback_t callback;
+	void* userdata;
+
+	uint8_t* buffer;
+	size_t length;
+	size_t result;
+
+	struct
+	{
+		uint8_t* data;
+		size_t size;
+	} staging;
+
+#if defined(FA_URING_ENABLE)
+	struct iovec iov;
+#endif
+};
+
+#if defined(FA_URING_ENABLE)
+typedef struct fa_uring_t fa_uring_t;
+
+struct fa_uring_t
+{
+	int fd;
+	uint32_t entries;
+	uint32_t queued;	// in the submission queue, not yet accepted by the kernel
+	uint32_t inflight;	// accepted by the kernel, not yet completed
+
+	struct
+	{
+		uint32_t* head;
+		uint32_t* tail;
+		uint32_t* mask;
+		uint32_t* array;
+		struct io_uring_sqe* sqes;
+		void* ring;
+		size_t ringSize;
+		size_t sqesSize;
+	} sq;
+
+	struct
+	{
+		uint32_t* head;
+		uint32_t* tail;
+		uint32_t* mask;
+		struct io_uring_cqe* cqes;
+		void* ring;
+		size_t ringSize;
+	} cq;
+};
+#endif
+
+struct fa_async_t
+{
+	struct
+	{
+		fa_async_request_t* first;
+		fa_async_request_t* last;
+	} pending;
+
+	uint32_t outstanding;
+
+#if defined(FA_URING_ENABLE)
+	fa_uring_t* ring;
+#endif
+};
+
+static void prepareRequest(fa_async_request_t* request, uint64_t* offset, size_t* length);
+static void completeRequest(fa_async_request_t* request, size_t result);
+static int unlinkRequest(fa_async_t* async, fa_async_request_t* request);
+
+#if defined(FA_URING_ENABLE)
+static fa_uring_t* createRing(uint32_t entries);
+static void destroyRing(fa_uring_t* ring);
+static int submitRing(fa_archive_t* archive, int wait);
+#endif
+
+int fa_read_async(fa_file_t* file, void* buffer, size_t length, fa_read_callback_t callback, void* userdata)
+{
+	fa_archive_t* archive;
+	fa_async_request_t* request;
+	fa_async_t* async;
+
+	if ((file == NULL) || (file->archive->mode != FA_MODE_READ) || (callback == NULL) || (file->stream != NULL) || (file->async != NULL))
+	{
+		return -1;
+	}
+
+	archive = file->archive;
+
+	if (archive->async == NULL)
+	{
+		async = malloc(sizeof(fa_async_t));
+		memset(async, 0, sizeof(fa_async_t));
+
+#if defined(FA_URING_ENABLE)
+		if (archive->ops == fa_get_default_ops())
+		{
+			async->ring = createRing(FA_ASYNC_QUEUE_SIZE);
+		}
+#endif
+
+		archive->async = async;
+	}
+
+	async = archive->async;
+
+	request = malloc(sizeof(fa_async_request_t));
+	memset(request, 0, sizeof(fa_async_request_t));
+
+	request->file = file;
+	request->callback = callback;
+	request->userdata = userdata;
+	request->buffer = buffer;
+	request->length = length;
+
+	file->async = request;
+
+	// drain what is already decoded in the file buffer, the rest is read when submitted
+
+	if (file->buffer.fill > file->buffer.offset)
+	{
+		size_t maxRead = length > (file->buffer.fill - file->buffer.offset) ? (file->buffer.fill - file->buffer.offset) : length;
+
+		memcpy(request->buffer, file->buffer.data + file->buffer.offset, maxRead);
+		file->buffer.offset += maxRead;
+
+		request->result = maxRead;
+	}
+
+	fa_release_window(file);
+
+	if (async->pending.last != NULL)
+	{
+		async->pending.last->next = request;
+	}
+	else
+	{
+		async->pending.first = request;
+	}
+	async->pending.last = request;
+
+	++ async->outstanding;
+	return 0;
+}
+
+int fa_poll(fa_archive_t* archive, int wait)
+{
+	fa_async_t* async;
+	int completed = 0;
+
+	if ((archive == NULL) || (archive->mode != FA_MODE_READ))
+	{
+		return -1;
+	}
+
+	async = archive->async;
+	if ((async == NULL) || (async->outstanding == 0))
+	{
+		return 0;
+	}
+
+#if defined(FA_URING_ENABLE)
+	if (async->ring != NULL)
+	{
+		return submitRing(archive, wait);
+	}
+#endif
+
+	while (async->pending.first != NULL)
+	{
+		fa_async_request_t* request = async->pending.first;
+		uint64_t offset;
+		size_t length;
+
+		async->pending.first = request->next;
+		if (async->pending.first == NULL)
+		{
+			async->pending.last = NULL;
+		}
+
+		prepareRequest(request, &offset, &length);
+
+		if (length > 0)
+		{
+			length = archive->ops->pread(archive->handle, request->staging.data != NULL ? request->staging.data : request->buffer + request->result, length, offset);
+		}
+
+		-- async->outstanding;
+		completeRequest(request, length);
+		++ completed;
+	}
+
+	return completed;
+}
+
+void fa_async_complete(fa_file_t* file)
+{
+	fa_async_t* async = file->archive->async;
+
+	// the callback must run before the file handle can be recycled
+
+	while (file->async != NULL)
+	{
+		if (fa_poll(file->archive, 1) >= 0)
+		{
+			continue;
+		}
+
+		// reads still waiting for submission complete without any data; a read in flight cannot be abandoned
+
+		if (unlinkRequest(async, file->async) < 0)
+		{
+			break;
+		}
+
+		-- async->outstanding;
+		completeRequest(file->async, 0);
+	}
+}
+
+void fa_async_destroy(fa_archive_t* archive)
+{
+	fa_async_t* async = archive->async;
+
+	if (async == NULL)
+	{
+		return;
+	}
+
+	while (async->outstanding > 0)
+	{
+		if (fa_poll(archive, 1) < 0)
+		{
+			break;
+		}
+	}
+
+#if defined(FA_URING_ENABLE)
+	if (async->ring != NULL)
+	{
+		destroyRing(async->ring);
+	}
+#endif
+
+	free(async);
+	archive->async = NULL;
+}
+
+static void prepareRequest(fa_async_request_t* request, uint64_t* offset, size_t* length)
+{
+	fa_file_t* file = request->file;
+	const fa_entry_t* entry = file->entry;
+	size_t left = request->length - request->result;
+
+	*offset = file->base + file->offset.compressed;
+
+	if (entry->compression == FA_COMPRESSION_NONE)
+	{
+		size_t maxFileRead = entry->size.original - file->offset.original;
+		*length = left > maxFileRead ? maxFileRead : left;
+	}
+	else
+	{
+		// the file buffer has been drained, so reading starts on a block boundary
+
+		size_t maxFileRead = entry->size.compressed - file->offset.compressed;
+		size_t blockSize = entry->blockSize != 0 ? entry->blockSize : file->archive->blockSize;
+		size_t blocks = (left + blockSize - 1) / blockSize;
+		size_t maxRead = blocks * (blockSize + file->archive->blockHeader);
+
+		*length = maxRead > maxFileRead ? maxFileRead : maxRead;
+
+		if ((left > 0) && (*length > 0))
+		{
+			request->staging.data = malloc(*length);
+			request->staging.size = *length;
+		}
+		else
+		{
+			*length = 0;
+		}
+	}
+}
+
+static void completeRequest(fa_async_request_t* request, size_t result)
+{
+	fa_file_t* file = request->file;
+
+	if (request->staging.data != NULL)
+	{
+		request->result += fa_decode_blocks(file, request->staging.data, result, request->buffer + request->result, request->length - request->result);
+		free(request->staging.data);
+	}
+	else if ((file->entry->compression == FA_COMPRESSION_NONE) && (result > 0))
+	{
+		file->buffer.offset = 0;
+		file->buffer.fill = 0;
+
+		file->offset.original += result;
+		file->offset.compressed += result;
+
+		request->result += result;
+	}
+
+	file->async = NULL;
+
+	request->callback(file, request->buffer, request->result, request->userdata);
+	free(request);
+}
+
+static int unlinkRequest(fa_async_t* async, fa_async_request_t* request)
+{
+	fa_async_request_t** link = &(async->pending.first);
+	fa_async_request_t* previous = NULL;
+
+	while ((*link != NULL) && (*link != request))
+	{
+		previous = *link;
+		link = &((*link)->next);
+	}
+
+	if (*link == NULL)
+	{
+		return -1;
+	}
+
+	*link = request->next;
+	if (async->pending.last == request)
+	{
+		async->pending.last = previous;
+	}
+
+	return 0;
+}
+
+#if defined(FA_URING_ENABLE)
+
+static fa_uring_t* createRing(uint32_t entries)
+{
+	struct io_uring_params params;
+	fa_uring_t* ring;
+	int fd;
+
+	memset(&params, 0, sizeof(params));
+
+	fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	ring = malloc(sizeof(fa_uring_t));
+	memset(ring, 0, sizeof(fa_uring_t));
+
+	ring->fd = fd;
+	ring->entries = params.sq_entries;
+
+	do
+	{
+		uint8_t* sq;
+		uint8_t* cq;
+
+		ring->sq.ringSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		ring->cq.ringSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			if (ring->cq.ringSize > ring->sq.ringSize)
+			{
+				ring->sq.ringSize = ring->cq.ringSize;
+			}
+			ring->cq.ringSize = 0;
+		}
+
+		ring->sq.ring = mmap(NULL, ring->sq.ringSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (ring->sq.ring == MAP_FAILED)
+		{
+			ring->sq.ring = NULL;
+			break;
+		}
+
+		if (ring->cq.ringSize > 0)
+		{
+			ring->cq.ring = mmap(NULL, ring->cq.ringSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			if (ring->cq.ring == MAP_FAILED)
+			{
+				ring->cq.ring = NULL;
+				break;
+			}
+		}
+
+		ring->sq.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+		ring->sq.sqes = mmap(NULL, ring->sq.sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+		if (ring->sq.sqes == MAP_FAILED)
+		{
+			ring->sq.sqes = NULL;
+			break;
+		}
+
+		sq = (uint8_t*)ring->sq.ring;
+		cq = ring->cq.ring != NULL ? (uint8_t*)ring->cq.ring : sq;
+
+		ring->sq.head = (uint32_t*)(sq + params.sq_off.head);
+		ring->sq.tail = (uint32_t*)(sq + params.sq_off.tail);
+		ring->sq.mask = (uint32_t*)(sq + params.sq_off.ring_mask);
+		ring->sq.array = (uint32_t*)(sq + params.sq_off.array);
+
+		ring->cq.head = (uint32_t*)(cq + params.cq_off.head);
+		ring->cq.tail = (uint32_t*)(cq + params.cq_off.tail);
+		ring->cq.mask = (uint32_t*)(cq + params.cq_off.ring_mask);
+		ring->cq.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+		return ring;
+	}
+	while (0);
+
+	destroyRing(ring);
+	return NULL;
+}
+
+static void destroyRing(fa_uring_t* ring)
+{
+	if (ring->sq.sqes != NULL)
+	{
+		munmap(ring->sq.sqes, ring->sq.sqesSize);
+	}
+
+	if (ring->cq.ring != NULL)
+	{
+		munmap(ring->cq.ring, ring->cq.ringSize);
+	}
+
+	if (ring->sq.ring != NULL)
+	{
+		munmap(ring->sq.ring, ring->sq.ringSize);
+	}
+
+	close(ring->fd);
+	free(ring);
+}
+
+static int submitRing(fa_archive_t* archive, int wait)
+{
+	fa_async_t* async = archive->async;
+	fa_uring_t* ring = async->ring;
+	uint32_t tail, head;
+	int completed = 0;
+
+	// queue as many pending requests as the ring allows; reads that need no I/O complete right away
+
+	tail = *ring->sq.tail;
+	while ((async->pending.first != NULL) && ((ring->queued + ring->inflight) < ring->entries))
+	{
+		fa_async_request_t* request = async->pending.first;
+		struct io_uring_sqe* sqe;
+		uint32_t index;
+		uint64_t offset;
+		size_t length;
+
+		async->pending.first = request->next;
+		if (async->pending.first == NULL)
+		{
+			async->pending.last = NULL;
+		}
+
+		prepareRequest(request, &offset, &length);
+
+		if (length == 0)
+		{
+			-- async->outstanding;
+			completeRequest(request, 0);
+			++ completed;
+			continue;
+		}
+
+		request->iov.iov_base = request->staging.data != NULL ? request->staging.data : request->buffer + request->result;
+		request->iov.iov_len = length;
+
+		index = tail & *ring->sq.mask;
+		sqe = &(ring->sq.sqes[index]);
+
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = (int)(intptr_t)archive->handle;
+		sqe->off = offset;
+		sqe->addr = (uint64_t)(uintptr_t)&(request->iov);
+		sqe->len = 1;
+		sqe->user_data = (uint64_t)(uintptr_t)request;
+
+		ring->sq.array[index] = index;
+		++ tail;
+
+		++ ring->queued;
+	}
+	__atomic_store_n(ring->sq.tail, tail, __ATOMIC_RELEASE);
+
+	// entries the kernel does not accept stay in the submission queue and are passed on again by the next call
+
+	if ((ring->queued > 0) || (ring->inflight > 0))
+	{
+		unsigned minComplete = (wait && (completed == 0)) ? 1 : 0;
+		unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+		long result = 0;
+
+		if ((ring->queued > 0) || (minComplete > 0))
+		{
+			result = syscall(__NR_io_uring_enter, ring->fd, ring->queued, minComplete, flags, NULL, 0);
+			if ((result < 0) && (errno != EINTR))
+			{
+				return -1;
+			}
+		}
+
+		if (result > 0)
+		{
+			ring->queued -= (uint32_t)result;
+			ring->inflight += (uint32_t)result;
+		}
+	}
+
+	// reap completions
+
+	head = *ring->cq.head;
+	for (;;)
+	{
+		fa_async_request_t* request;
+		struct io_uring_cqe* cqe;
+
+		if (head == __atomic_load_n(ring->cq.tail, __ATOMIC_ACQUIRE))
+		{
+			break;
+		}
+
+		cqe = &(ring->cq.cqes[head & *ring->cq.mask]);
+		request = (fa_async_request_t*)(uintptr_t)cqe->user_data;
+		++ head;
+
+		-- ring->inflight;
+		-- async->outstanding;
+		completeRequest(request, cqe->res < 0 ? 0 : (size_t)cqe->res);
+		++ completed;
+	}
+	__atomic_store_n(ring->cq.head, head, __ATOMIC_RELEASE);
+
+	return completed;
+}
+
+#endif
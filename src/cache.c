@@ -0,0 +1,292 @@
+/*
+
+Copyright (c) 2010 Jesper Svennevid
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <filearchive/internal/api.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#pragma warning(disable: 4127)
+#endif
+
+#define FA_BLOCK_CACHE_MIN_BUCKETS (16)
+
+typedef struct fa_cached_block_t fa_cached_block_t;
+
+struct fa_cached_block_t
+{
+	fa_cached_block_t* next;	// next block in bucket
+	fa_cached_block_t* older;	// LRU list
+	fa_cached_block_t* newer;
+
+	uint32_t entry;
+	uint32_t block;
+
+	uint32_t original;
+	uint32_t compressed;
+};
+
+struct fa_block_cache_t
+{
+	size_t budget;
+	size_t used;
+
+	fa_cached_block_t** buckets;
+	uint32_t mask;
+
+	fa_cached_block_t* oldest;
+	fa_cached_block_t* newest;
+
+	fa_mutex_t* mutex;
+};
+
+static fa_cached_block_t** findBlock(fa_block_cache_t* cache, uint32_t entry, uint32_t block);
+static void unlinkBlock(fa_block_cache_t* cache, fa_cached_block_t* cached);
+static void linkBlock(fa_block_cache_t* cache, fa_cached_block_t* cached);
+
+int fa_set_block_cache(fa_archive_t* archive, size_t budget)
+{
+	fa_block_cache_t* cache;
+	uint32_t buckets = FA_BLOCK_CACHE_MIN_BUCKETS;
+
+	if ((archive == NULL) || (archive->mode != FA_MODE_READ))
+	{
+		return -1;
+	}
+
+	fa_block_cache_destroy(archive);
+
+	if (budget == 0)
+	{
+		return 0;
+	}
+
+	// size table for about two buckets per full block that fits in the budget
+
+	while ((buckets < (1u << 30)) && ((size_t)buckets * (archive->blockSize / 2) < budget))
+	{
+		buckets <<= 1;
+	}
+
+	cache = malloc(sizeof(fa_block_cache_t));
+	if (cache == NULL)
+	{
+		return -1;
+	}
+
+	memset(cache, 0, sizeof(fa_block_cache_t));
+
+	cache->budget = budget;
+	cache->mask = buckets - 1;
+	cache->buckets = calloc(buckets, sizeof(fa_cached_block_t*));
+	cache->mutex = fa_mutex_create();
+
+	if ((cache->buckets == NULL) || (cache->mutex == NULL))
+	{
+		fa_mutex_destroy(cache->mutex);
+		free(cache->buckets);
+		free(cache);
+		return -1;
+	}
+
+	archive->blockCache = cache;
+	return 0;
+}
+
+int fa_block_cache_read(fa_archive_t* archive, uint32_t entry, uint32_t block, void* buffer, uint32_t size, uint32_t* compressed)
+{
+	fa_block_cache_t* cache = archive->blockCache;
+	fa_cached_block_t* cached;
+	int result;
+
+	if (cache == NULL)
+	{
+		return -1;
+	}
+
+	fa_mutex_lock(cache->mutex);
+
+	cached = *findBlock(cache, entry, block);
+	if ((cached == NULL) || (cached->original > size))
+	{
+		fa_mutex_unlock(cache->mutex);
+		return -1;
+	}
+
+	if (cached != cache->newest)
+	{
+		unlinkBlock(cache, cached);
+		linkBlock(cache, cached);
+	}
+
+	memcpy(buffer, cached + 1, cached->original);
+
+	if (compressed)
+	{
+		*compressed = cached->compressed;
+	}
+
+	result = (int)cached->original;
+
+	fa_mutex_unlock(cache->mutex);
+
+	return result;
+}
+
+void fa_block_cache_write(fa_archive_t* archive, uint32_t entry, uint32_t block, const void* buffer, uint32_t original, uint32_t compressed)
+{
+	fa_block_cache_t* cache = archive->blockCache;
+	fa_cached_block_t** slot;
+	fa_cached_block_t* cached;
+	size_t size = sizeof(fa_cached_block_t) + original;
+
+	if ((cache == NULL) || (size > cache->budget))
+	{
+		return;
+	}
+
+	cached = malloc(size);
+	if (cached == NULL)
+	{
+		return;
+	}
+
+	cached->entry = entry;
+	cached->block = block;
+	cached->original = original;
+	cached->compressed = compressed;
+
+	memcpy(cached + 1, buffer, original);
+
+	fa_mutex_lock(cache->mutex);
+
+	slot = findBlock(cache, entry, block);
+	if (*slot != NULL)
+	{
+		fa_mutex_unlock(cache->mutex);
+		free(cached);
+		return;
+	}
+
+	// evict least recently used blocks until the new block fits
+
+	while ((cache->oldest != NULL) && ((cache->used + size) > cache->budget))
+	{
+		fa_cached_block_t* oldest = cache->oldest;
+		fa_cached_block_t** oldestSlot = findBlock(cache, oldest->entry, oldest->block);
+
+		*oldestSlot = oldest->next;
+
+		unlinkBlock(cache, oldest);
+		cache->used -= sizeof(fa_cached_block_t) + oldest->original;
+
+		free(oldest);
+	}
+
+	// eviction may have unlinked the block preceding the slot
+
+	slot = findBlock(cache, entry, block);
+	cached->next = *slot;
+	*slot = cached;
+
+	linkBlock(cache, cached);
+	cache->used += size;
+
+	fa_mutex_unlock(cache->mutex);
+}
+
+void fa_block_cache_destroy(fa_archive_t* archive)
+{
+	fa_block_cache_t* cache = archive->blockCache;
+
+	if (cache == NULL)
+	{
+		return;
+	}
+
+	while (cache->oldest != NULL)
+	{
+		fa_cached_block_t* oldest = cache->oldest;
+		cache->oldest = oldest->newer;
+		free(oldest);
+	}
+
+	fa_mutex_destroy(cache->mutex);
+	free(cache->buckets);
+	free(cache);
+
+	archive->blockCache = NULL;
+}
+
+static fa_cached_block_t** findBlock(fa_block_cache_t* cache, uint32_t entry, uint32_t block)
+{
+	uint32_t hash = (entry * 0x9e3779b1u) ^ (block * 0x85ebca6bu);
+	fa_cached_block_t** slot = &(cache->buckets[(hash ^ (hash >> 16)) & cache->mask]);
+
+	while ((*slot != NULL) && (((*slot)->entry != entry) || ((*slot)->block != block)))
+	{
+		slot = &((*slot)->next);
+	}
+
+	return slot;
+}
+
+static void unlinkBlock(fa_block_cache_t* cache, fa_cached_block_t* cached)
+{
+	if (cached->older != NULL)
+	{
+		cached->older->newer = cached->newer;
+	}
+	else
+	{
+		cache->oldest = cached->newer;
+	}
+
+	if (cached->newer != NULL)
+	{
+		cached->newer->older = cached->older;
+	}
+	else
+	{
+		cache->newest = cached->older;
+	}
+}
+
+static void linkBlock(fa_block_cache_t* cache, fa_cached_block_t* cached)
+{
+	cached->older = cache->newest;
+	cached->newer = NULL;
+
+	if (cache->newest != NULL)
+	{
+		cache->newest->newer = cached;
+	}
+	else
+	{
+		cache->oldest = cached;
+	}
+
+	cache->newest = cached;
+}
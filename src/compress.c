@@ -34,8 +34,278 @@ SOFTWARE.
 #include <lzma.h>
 #endif
 
-size_t fa_compress_block(fa_compression_t compression, void* out, size_t outSize, const void* in, size_t inSize)
+#if defined(FA_ZSTD_ENABLE)
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+#if defined(FA_LZ4_ENABLE)
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+struct fa_dictionary_t
+{
+#if defined(FA_ZSTD_ENABLE)
+	ZSTD_CDict* compress;
+	ZSTD_DDict* decompress;
+#else
+	int unused;
+#endif
+};
+
+struct fa_codec_t
+{
+#if defined(FA_ZLIB_ENABLE)
+	z_stream deflate;
+	z_stream inflate;
+	int deflateReady;
+	int inflateReady;
+	int deflateLevel;
+#endif
+
+#if defined(FA_LZMA_ENABLE)
+	lzma_stream encoder;
+	lzma_stream decoder;
+	lzma_options_lzma options;
+	uint32_t preset;
+#endif
+
+#if defined(FA_ZSTD_ENABLE)
+	ZSTD_CCtx* compress;
+	ZSTD_DCtx* decompress;
+#endif
+
+#if defined(FA_LZ4_ENABLE)
+	void* state;
+	void* stateHC;
+#endif
+
+	int unused;
+};
+
+static int scaleLevel(int level, int fallback, int min, int max);
+#if defined(FA_LZMA_ENABLE)
+static void growWindow(fa_codec_t* codec, size_t size);
+#endif
+#if defined(FA_ZSTD_ENABLE)
+static int zstdLevel(int level);
+#endif
+
+int fa_set_dictionary(fa_archive_t* archive, const void* data, size_t size)
+{
+	fa_archive_writer_t* writer = (fa_archive_writer_t*)archive;
+	fa_dictionary_t* dictionary;
+	uint8_t* copy;
+
+	if ((archive == NULL) || (archive->mode != FA_MODE_WRITE) || (writer->entries.count > 0) || (data == NULL) || (size == 0) || (size > 0x7fffffff))
+	{
+		return -1;
+	}
+
+	dictionary = fa_dictionary_create(data, size, FA_MODE_WRITE, writer->options.level);
+	if (dictionary == NULL)
+	{
+		return -1;
+	}
+
+	copy = malloc(size);
+	if (copy == NULL)
+	{
+		fa_dictionary_destroy(dictionary);
+		return -1;
+	}
+
+	memcpy(copy, data, size);
+
+	fa_dictionary_destroy(archive->dictionary);
+	free(writer->dictionary.data);
+
+	archive->dictionary = dictionary;
+	writer->dictionary.data = copy;
+	writer->dictionary.size = (uint32_t)size;
+
+	return 0;
+}
+
+int fa_set_compression_options(fa_archive_t* archive, const fa_compression_options_t* options)
+{
+	fa_archive_writer_t* writer = (fa_archive_writer_t*)archive;
+	fa_compression_options_t defaults;
+
+	if ((archive == NULL) || (archive->mode != FA_MODE_WRITE))
+	{
+		return -1;
+	}
+
+	if (options == NULL)
+	{
+		memset(&defaults, 0, sizeof(defaults));
+		options = &defaults;
+	}
+
+	if ((options->level < FA_COMPRESSION_LEVEL_DEFAULT) || (options->level > FA_COMPRESSION_LEVEL_BEST))
+	{
+		return -1;
+	}
+
+	// the digested dictionary is bound to a compression level
+
+	if ((archive->dictionary != NULL) && (options->level != writer->options.level))
+	{
+		fa_dictionary_t* dictionary = fa_dictionary_create(writer->dictionary.data, writer->dictionary.size, FA_MODE_WRITE, options->level);
+		if (dictionary == NULL)
+		{
+			return -1;
+		}
+
+		fa_dictionary_destroy(archive->dictionary);
+		archive->dictionary = dictionary;
+	}
+
+	writer->options = *options;
+
+	return 0;
+}
+
+size_t fa_train_dictionary(void* dictionary, size_t capacity, const void* samples, const size_t* sizes, uint32_t count)
+{
+#if defined(FA_ZSTD_ENABLE)
+	size_t result;
+
+	if ((dictionary == NULL) || (samples == NULL) || (sizes == NULL) || (count == 0))
+	{
+		return 0;
+	}
+
+	result = ZDICT_trainFromBuffer(dictionary, capacity, samples, sizes, count);
+
+	return ZDICT_isError(result) ? 0 : result;
+#else
+	return 0;
+#endif
+}
+
+fa_dictionary_t* fa_dictionary_create(const void* data, size_t size, fa_mode_t mode, int level)
+{
+#if defined(FA_ZSTD_ENABLE)
+	fa_dictionary_t* dictionary = malloc(sizeof(fa_dictionary_t));
+
+	if (dictionary == NULL)
+	{
+		return NULL;
+	}
+
+	// digest the dictionary once; only the half matching the archive mode is needed
+
+	dictionary->compress = mode == FA_MODE_WRITE ? ZSTD_createCDict(data, size, zstdLevel(level)) : NULL;
+	dictionary->decompress = mode == FA_MODE_READ ? ZSTD_createDDict(data, size) : NULL;
+
+	if ((dictionary->compress == NULL) && (dictionary->decompress == NULL))
+	{
+		free(dictionary);
+		return NULL;
+	}
+
+	return dictionary;
+#else
+	return NULL;
+#endif
+}
+
+void fa_dictionary_destroy(fa_dictionary_t* dictionary)
+{
+	if (dictionary == NULL)
+	{
+		return;
+	}
+
+#if defined(FA_ZSTD_ENABLE)
+	ZSTD_freeCDict(dictionary->compress);
+	ZSTD_freeDDict(dictionary->decompress);
+#endif
+	free(dictionary);
+}
+
+fa_codec_t* fa_codec_create()
+{
+	fa_codec_t* codec = malloc(sizeof(fa_codec_t));
+
+	if (codec == NULL)
+	{
+		return NULL;
+	}
+
+	memset(codec, 0, sizeof(fa_codec_t));
+
+#if defined(FA_LZMA_ENABLE)
+	if (lzma_lzma_preset(&(codec->options), LZMA_PRESET_DEFAULT))
+	{
+		free(codec);
+		return NULL;
+	}
+
+	codec->preset = LZMA_PRESET_DEFAULT;
+
+	// matches never reach outside a block, so the window only needs to grow with the largest block seen (see growWindow)
+
+	codec->options.dict_size = FA_COMPRESSION_MAX_BLOCK > LZMA_DICT_SIZE_MIN ? FA_COMPRESSION_MAX_BLOCK : LZMA_DICT_SIZE_MIN;
+#endif
+
+	return codec;
+}
+
+void fa_codec_destroy(fa_codec_t* codec)
 {
+	if (codec == NULL)
+	{
+		return;
+	}
+
+#if defined(FA_ZLIB_ENABLE)
+	if (codec->deflateReady)
+	{
+		deflateEnd(&(codec->deflate));
+	}
+
+	if (codec->inflateReady)
+	{
+		inflateEnd(&(codec->inflate));
+	}
+#endif
+
+#if defined(FA_LZMA_ENABLE)
+	lzma_end(&(codec->encoder));
+	lzma_end(&(codec->decoder));
+#endif
+
+#if defined(FA_ZSTD_ENABLE)
+	ZSTD_freeCCtx(codec->compress);
+	ZSTD_freeDCtx(codec->decompress);
+#endif
+
+#if defined(FA_LZ4_ENABLE)
+	free(codec->state);
+	free(codec->stateHC);
+#endif
+
+	free(codec);
+}
+
+size_t fa_compress_block(fa_codec_t* codec, fa_compression_t compression, int level, const fa_dictionary_t* dictionary, void* out, size_t outSize, const void* in, size_t inSize)
+{
+	if (codec == NULL)
+	{
+		fa_codec_t* temporary = fa_codec_create();
+		size_t result = temporary != NULL ? fa_compress_block(temporary, compression, level, dictionary, out, outSize, in, inSize) : inSize;
+
+		fa_codec_destroy(temporary);
+		return result;
+	}
+
 	switch (compression)
 	{
 		default: return inSize;
@@ -47,25 +317,56 @@ size_t fa_compress_block(fa_compression_t compression, void* out, size_t outSize
 				return inSize;
 			}
 
-			return fastlz_compress_level(2, in, inSize, out);
+			return fastlz_compress_level(scaleLevel(level, 2, 1, 2), in, inSize, out);
 		}
 		break;
 #if defined(FA_ZLIB_ENABLE)
 		case FA_COMPRESSION_DEFLATE:
 		{
-			uLongf destLen = outSize;
+			z_stream* stream = &(codec->deflate);
+			int deflateLevel = scaleLevel(level, Z_DEFAULT_COMPRESSION, 1, 9);
 
 			if (outSize < compressBound(inSize))
 			{
 				return inSize;
 			}
 
-			if (compress2(out, &destLen, in, inSize, Z_DEFAULT_COMPRESSION) != Z_OK)
+			if (!codec->deflateReady)
+			{
+				if (deflateInit(stream, deflateLevel) != Z_OK)
+				{
+					return inSize;
+				}
+
+				codec->deflateReady = 1;
+				codec->deflateLevel = deflateLevel;
+			}
+			else if (deflateReset(stream) != Z_OK)
 			{
 				return inSize;
 			}
 
-			return destLen;
+			if (deflateLevel != codec->deflateLevel)
+			{
+				if (deflateParams(stream, deflateLevel, Z_DEFAULT_STRATEGY) != Z_OK)
+				{
+					return inSize;
+				}
+
+				codec->deflateLevel = deflateLevel;
+			}
+
+			stream->next_in = (Bytef*)in;
+			stream->avail_in = (uInt)inSize;
+			stream->next_out = out;
+			stream->avail_out = (uInt)outSize;
+
+			if (deflate(stream, Z_FINISH) != Z_STREAM_END)
+			{
+				return inSize;
+			}
+
+			return stream->total_out;
 		}
 		break;
 #endif
@@ -73,33 +374,148 @@ size_t fa_compress_block(fa_compression_t compression, void* out, size_t outSize
 #if defined(FA_LZMA_ENABLE)
 		case FA_COMPRESSION_LZMA2:
 		{
-			size_t outPos = 0;
+			lzma_stream* stream = &(codec->encoder);
+			uint32_t preset = (uint32_t)scaleLevel(level, LZMA_PRESET_DEFAULT, 0, 9);
 			lzma_filter filters[2];
-			lzma_options_lzma options;
+			lzma_ret ret;
 
-			if (lzma_lzma_preset(&options, 6))
+			// a new preset replaces every option except the window, which only tracks block sizes
+
+			if (preset != codec->preset)
 			{
-				return inSize;
+				uint32_t window = codec->options.dict_size;
+
+				if (lzma_lzma_preset(&(codec->options), preset))
+				{
+					return inSize;
+				}
+
+				codec->options.dict_size = window;
+				codec->preset = preset;
 			}
 
 			filters[0].id = LZMA_FILTER_LZMA2;
-			filters[0].options = &options;
+			filters[0].options = &(codec->options);
 			filters[1].id = LZMA_VLI_UNKNOWN;
 
-			lzma_ret ret = lzma_raw_buffer_encode(filters, NULL, in, inSize, out, &outPos, outSize);
-			if (ret != LZMA_OK)
+			// re-initializing an existing stream with the same filters reuses its allocations
+
+			growWindow(codec, inSize);
+
+			if (lzma_raw_encoder(stream, filters) != LZMA_OK)
+			{
+				return inSize;
+			}
+
+			stream->next_in = in;
+			stream->avail_in = inSize;
+			stream->next_out = out;
+			stream->avail_out = outSize;
+
+			do
+			{
+				ret = lzma_code(stream, LZMA_FINISH);
+			}
+			while (ret == LZMA_OK);
+
+			if (ret != LZMA_STREAM_END)
+			{
+				return inSize;
+			}
+
+			return outSize - stream->avail_out;
+		}
+		break;
+#endif
+
+#if defined(FA_ZSTD_ENABLE)
+		case FA_COMPRESSION_ZSTD:
+		{
+			size_t result;
+
+			if (outSize < ZSTD_compressBound(inSize))
 			{
 				return inSize;
 			}
-			return outPos;
+
+			if (codec->compress == NULL)
+			{
+				codec->compress = ZSTD_createCCtx();
+				if (codec->compress == NULL)
+				{
+					return inSize;
+				}
+			}
+
+			ZSTD_CCtx_reset(codec->compress, ZSTD_reset_session_and_parameters);
+
+			// the dictionary is implied by the archive, so leave its id out of every block
+
+			ZSTD_CCtx_setParameter(codec->compress, ZSTD_c_compressionLevel, zstdLevel(level));
+			ZSTD_CCtx_setParameter(codec->compress, ZSTD_c_dictIDFlag, 0);
+
+			if ((dictionary != NULL) && (dictionary->compress != NULL))
+			{
+				ZSTD_CCtx_refCDict(codec->compress, dictionary->compress);
+			}
+
+			result = ZSTD_compress2(codec->compress, out, outSize, in, inSize);
+
+			return ZSTD_isError(result) ? inSize : result;
+		}
+		break;
+#endif
+
+#if defined(FA_LZ4_ENABLE)
+		case FA_COMPRESSION_LZ4:
+		case FA_COMPRESSION_LZ4HC:
+		{
+			void** state = compression == FA_COMPRESSION_LZ4HC ? &(codec->stateHC) : &(codec->state);
+			int result;
+
+			if ((inSize > LZ4_MAX_INPUT_SIZE) || (outSize < (size_t)LZ4_compressBound((int)inSize)))
+			{
+				return inSize;
+			}
+
+			if (*state == NULL)
+			{
+				*state = malloc(compression == FA_COMPRESSION_LZ4HC ? LZ4_sizeofStateHC() : LZ4_sizeofState());
+				if (*state == NULL)
+				{
+					return inSize;
+				}
+			}
+
+			if (compression == FA_COMPRESSION_LZ4HC)
+			{
+				result = LZ4_compress_HC_extStateHC(*state, in, out, (int)inSize, (int)outSize, scaleLevel(level, LZ4HC_CLEVEL_DEFAULT, LZ4HC_CLEVEL_MIN, LZ4HC_CLEVEL_MAX));
+			}
+			else
+			{
+				// lower levels trade ratio for speed through a larger acceleration factor
+
+				result = LZ4_compress_fast_extState(*state, in, out, (int)inSize, (int)outSize, level != FA_COMPRESSION_LEVEL_DEFAULT ? 1 + FA_COMPRESSION_LEVEL_BEST - level : 1);
+			}
+
+			return result > 0 ? (size_t)result : inSize;
 		}
 		break;
 #endif
 	}
 }
 
-size_t fa_decompress_block(fa_compression_t compression, void* out, size_t outSize, const void* in, size_t inSize)
+size_t fa_decompress_block(fa_codec_t* codec, fa_compression_t compression, const fa_dictionary_t* dictionary, void* out, size_t outSize, const void* in, size_t inSize)
 {
+	if (codec == NULL)
+	{
+		fa_codec_t* temporary = fa_codec_create();
+		size_t result = temporary != NULL ? fa_decompress_block(temporary, compression, dictionary, out, outSize, in, inSize) : 0;
+
+		fa_codec_destroy(temporary);
+		return result;
+	}
+
 	switch (compression)
 	{
 		default: return 0;
@@ -112,14 +528,33 @@ size_t fa_decompress_block(fa_compression_t compression, void* out, size_t outSi
 #if defined(FA_ZLIB_ENABLE)
 		case FA_COMPRESSION_DEFLATE:
 		{
-			uLongf destLen = outSize;
+			z_stream* stream = &(codec->inflate);
 
-			if (uncompress(out, &destLen, in, inSize) != Z_OK)
+			if (!codec->inflateReady)
+			{
+				if (inflateInit(stream) != Z_OK)
+				{
+					return 0;
+				}
+
+				codec->inflateReady = 1;
+			}
+			else if (inflateReset(stream) != Z_OK)
 			{
 				return 0;
 			}
 
-			return destLen;
+			stream->next_in = (Bytef*)in;
+			stream->avail_in = (uInt)inSize;
+			stream->next_out = out;
+			stream->avail_out = (uInt)outSize;
+
+			if (inflate(stream, Z_FINISH) != Z_STREAM_END)
+			{
+				return 0;
+			}
+
+			return stream->total_out;
 		}
 		break;
 #endif
@@ -127,29 +562,121 @@ size_t fa_decompress_block(fa_compression_t compression, void* out, size_t outSi
 #if defined(FA_LZMA_ENABLE) 
 		case FA_COMPRESSION_LZMA2:
 		{
-			size_t inPos = 0, outPos = 0;
+			lzma_stream* stream = &(codec->decoder);
 			lzma_filter filters[2];
-			lzma_options_lzma options;
+			lzma_ret ret;
+
+			filters[0].id = LZMA_FILTER_LZMA2;
+			filters[0].options = &(codec->options);
+			filters[1].id = LZMA_VLI_UNKNOWN;
+
+			growWindow(codec, outSize);
 
-			if (lzma_lzma_preset(&options, 6))
+			if (lzma_raw_decoder(stream, filters) != LZMA_OK)
 			{
 				return 0;
 			}
 
-			filters[0].id = LZMA_FILTER_LZMA2;
-			filters[0].options = &options;
-			filters[1].id = LZMA_VLI_UNKNOWN;
+			stream->next_in = in;
+			stream->avail_in = inSize;
+			stream->next_out = out;
+			stream->avail_out = outSize;
 
-			lzma_ret ret = lzma_raw_buffer_decode(filters, NULL, in, &inPos, inSize, out, &outPos, outSize);
-			if (ret != LZMA_OK)
+			do
+			{
+				ret = lzma_code(stream, LZMA_FINISH);
+			}
+			while (ret == LZMA_OK);
+
+			if (ret != LZMA_STREAM_END)
 			{
 				return 0;
 			}
 
-			return outPos; 
+			return outSize - stream->avail_out; 
 		}
 		break;
 #endif
+
+#if defined(FA_ZSTD_ENABLE)
+		case FA_COMPRESSION_ZSTD:
+		{
+			size_t result;
+
+			if (codec->decompress == NULL)
+			{
+				codec->decompress = ZSTD_createDCtx();
+				if (codec->decompress == NULL)
+				{
+					return 0;
+				}
+			}
+
+			if ((dictionary != NULL) && (dictionary->decompress != NULL))
+			{
+				result = ZSTD_decompress_usingDDict(codec->decompress, out, outSize, in, inSize, dictionary->decompress);
+			}
+			else
+			{
+				result = ZSTD_decompressDCtx(codec->decompress, out, outSize, in, inSize);
+			}
+
+			return ZSTD_isError(result) ? 0 : result;
+		}
+		break;
+#endif
+
+#if defined(FA_LZ4_ENABLE)
+		case FA_COMPRESSION_LZ4:
+		case FA_COMPRESSION_LZ4HC:
+		{
+			int result;
+
+			if ((inSize > LZ4_MAX_INPUT_SIZE) || (outSize > LZ4_MAX_INPUT_SIZE))
+			{
+				return 0;
+			}
+
+			result = LZ4_decompress_safe(in, out, (int)inSize, (int)outSize);
+
+			return result > 0 ? (size_t)result : 0;
+		}
+		break;
+#endif
+	}
+}
+
+#if defined(FA_LZMA_ENABLE)
+static void growWindow(fa_codec_t* codec, size_t size)
+{
+	// the window only ever grows, so blocks of the common size keep reusing the stream allocations
+
+	while ((codec->options.dict_size < size) && (codec->options.dict_size < FA_BLOCK_SIZE_MAX))
+	{
+		codec->options.dict_size <<= 1;
+	}
+}
+#endif
+
+static int scaleLevel(int level, int fallback, int min, int max)
+{
+	const int range = FA_COMPRESSION_LEVEL_BEST - FA_COMPRESSION_LEVEL_FASTEST;
+
+	if (level == FA_COMPRESSION_LEVEL_DEFAULT)
+	{
+		return fallback;
 	}
+
+	// map linearly onto the codec range, rounding to the nearest level
+
+	return min + ((level - FA_COMPRESSION_LEVEL_FASTEST) * (max - min) + range / 2) / range;
 }
 
+#if defined(FA_ZSTD_ENABLE)
+static int zstdLevel(int level)
+{
+	// levels above 19 need far more memory than blocks of at most FA_BLOCK_SIZE_MAX can benefit from
+
+	return scaleLevel(level, ZSTD_CLEVEL_DEFAULT, 1, 19);
+}
+#endif
@@ -31,6 +31,26 @@ SOFTWARE.
 #pragma warning(disable: 4127)
 #endif
 
+#define FA_WALK_PATH_SIZE (256)
+
+typedef struct fa_query_state_t fa_query_state_t;
+
+struct fa_query_state_t
+{
+	fa_archive_t* archive;
+	fa_walk_callback_t callback;
+	void* userdata;
+
+	char* path;
+	size_t capacity;
+};
+
+static int reservePath(char** path, size_t* capacity, size_t length);
+static const char* containerName(const fa_archive_t* archive, const fa_container_t* container, size_t* length);
+static const fa_container_t* findChild(const fa_archive_t* archive, const fa_container_t* container, const char* name, size_t length);
+static int queryContainer(fa_query_state_t* state, const fa_container_t* container, size_t length, const char* pattern, int deep);
+static int matchName(const char* pattern, size_t length, const char* name);
+
 fa_dir_t* fa_opendir(fa_archive_t* archive, const char* path)
 {
 	fa_dir_t* dir = NULL;
@@ -50,10 +70,12 @@ fa_dir_t* fa_opendir(fa_archive_t* archive, const char* path)
 			break;
 		}
 
-		dir = malloc(sizeof(fa_dir_t));
-		memset(dir, 0, sizeof(fa_dir_t));
+		dir = fa_alloc_dir(archive);
+		if (dir == NULL)
+		{
+			break;
+		}
 
-		dir->archive = archive;
 		dir->parent = container;
 
 		dir->container = container->children != FA_INVALID_OFFSET ? (fa_container_t*)(((uint8_t*)archive->toc) + container->children) : NULL;
@@ -70,48 +92,96 @@ int fa_readdir(fa_dir_t* dir, fa_dirinfo_t* info)
 		return -1;
 	}
 
-	if (dir->container != NULL)
+	return fa_readdir_batch(dir, info, 1) == 1 ? 0 : -1;
+}
+
+size_t fa_readdir_batch(fa_dir_t* dir, fa_dirinfo_t* info, size_t max)
+{
+	const uint8_t* toc;
+	const fa_entry_t* entries;
+	const fa_hash_t* hashes;
+	size_t count = 0;
+
+	if ((dir == NULL) || (info == NULL))
 	{
-		fa_container_t* next;
+		return 0;
+	}
 
-		memset(info, 0, sizeof(fa_dirinfo_t));
+	toc = (const uint8_t*)dir->archive->toc;
 
-		next = dir->container->next != FA_INVALID_OFFSET ? (fa_container_t*)(((uint8_t*)dir->archive->toc) + dir->container->next) : NULL;
+	for (; (count < max) && (dir->container != NULL); ++count, ++info)
+	{
+		const fa_container_t* container = dir->container;
 
-		info->name = dir->container->name != FA_INVALID_OFFSET ? (const char*)(((uint8_t*)dir->archive->toc) + dir->container->name) : NULL;
+		info->name = container->name != FA_INVALID_OFFSET ? (const char*)(toc + container->name) : NULL;
 
 		info->type = FA_ENTRY_DIR;
 		info->compression = FA_COMPRESSION_NONE;
 
-		dir->container = next;
-		return 0;
+		info->size.original = 0;
+		info->size.compressed = 0;
+
+		memset(&(info->hash), 0, sizeof(fa_hash_t));
+
+		dir->container = container->next != FA_INVALID_OFFSET ? (const fa_container_t*)(toc + container->next) : NULL;
 	}
 
-	if (dir->index < dir->parent->entries.count)
+	if ((count == max) || (dir->index >= dir->parent->entries.count))
 	{
-		const fa_entry_t* entries = (const fa_entry_t*)(((uint8_t*)(dir->archive->toc)) + dir->archive->toc->entries.offset);
-		const fa_hash_t* hashes = (const fa_hash_t*)(((uint8_t*)(dir->archive->toc)) + dir->archive->toc->hashes);
-
-		const fa_entry_t* entry = ((const fa_entry_t*)(((uint8_t*)dir->archive->toc) + dir->parent->entries.offset)) + dir->index++;
-		const fa_hash_t* hash = hashes + (entry - entries); 
+		return count;
+	}
 
-		memset(info, 0, sizeof(fa_dirinfo_t));
+	entries = ((const fa_entry_t*)(toc + dir->parent->entries.offset)) + dir->index;
+	hashes = ((const fa_hash_t*)(toc + dir->archive->toc->hashes)) + (entries - (const fa_entry_t*)(toc + dir->archive->toc->entries.offset));
 
-		info->name = entry->name != FA_INVALID_OFFSET ? (const char*)(((uint8_t*)dir->archive->toc) + entry->name) : NULL;
+	for (; (count < max) && (dir->index < dir->parent->entries.count); ++count, ++info, ++entries, ++hashes)
+	{
+		info->name = entries->name != FA_INVALID_OFFSET ? (const char*)(toc + entries->name) : NULL;
 
 		info->type = FA_ENTRY_FILE;
-		info->compression = entry->compression;
+		info->compression = entries->compression;
+
+		info->size.original = entries->size.original;
+		info->size.compressed = entries->size.compressed;
+
+		info->hash = *hashes;
+
+		++ dir->index;
+	}
+
+	return count;
+}
 
-		info->size.original = entry->size.original;
-		info->size.compressed = entry->size.compressed;
+int fa_dir_entries(fa_dir_t* dir, fa_direntries_t* entries)
+{
+	const uint8_t* toc;
+	const fa_entry_t* first;
+
+	if ((dir == NULL) || (entries == NULL))
+	{
+		return -1;
+	}
+
+	toc = (const uint8_t*)dir->archive->toc;
 
-		info->hash = *hash;
+	entries->toc = toc;
+	entries->count = dir->parent->entries.count;
 
+	if (entries->count == 0)
+	{
+		entries->entries = NULL;
+		entries->hashes = NULL;
 		return 0;
 	}
 
-	return -1;	
-} 
+	first = (const fa_entry_t*)(toc + dir->parent->entries.offset);
+
+	entries->entries = first;
+	entries->hashes = ((const fa_hash_t*)(toc + dir->archive->toc->hashes)) + (first - (const fa_entry_t*)(toc + dir->archive->toc->entries.offset));
+
+	return 0;
+}
+ 
 
 int fa_closedir(fa_dir_t* dir)
 {
@@ -120,7 +190,7 @@ int fa_closedir(fa_dir_t* dir)
 		return -1;
 	}
 
-	free(dir);
+	fa_free_dir(dir);
 	return 0;
 }
 
@@ -128,13 +198,11 @@ int fa_closedir(fa_dir_t* dir)
 const fa_container_t* fa_find_container(const fa_archive_t* archive, const fa_container_t* container, const char* path)
 {
 	char* term;
-	fa_offset_t curr;
-	uint8_t* toc = (uint8_t*)(archive->toc);
 	const fa_container_t* child;
 
 	if (container == NULL)
 	{
-		container = (fa_container_t*)(toc + archive->toc->containers.offset);
+		container = (fa_container_t*)(((uint8_t*)archive->toc) + archive->toc->containers.offset);
 	}
 
 	term = strchr(path, '/');
@@ -143,22 +211,435 @@ const fa_container_t* fa_find_container(const fa_archive_t* archive, const fa_co
 		return container;
 	}
 
-	for (curr = container->children; curr != FA_INVALID_OFFSET;)
+	child = findChild(archive, container, path, term - path);
+
+	return child != NULL ? fa_find_container(archive, child, term + 1) : NULL;
+}
+
+int fa_walk(fa_archive_t* archive, const char* prefix, fa_walk_callback_t callback, void* userdata)
+{
+	const uint8_t* toc;
+	const fa_container_t* root;
+	const fa_container_t* container;
+	const char* base;
+	char* path = NULL;
+	size_t capacity = 0;
+	size_t length;
+	int result = -1;
+
+	if ((archive == NULL) || (archive->mode != FA_MODE_READ) || (callback == NULL))
+	{
+		return -1;
+	}
+
+	prefix = prefix != NULL ? prefix : "";
+
+	root = fa_find_container(archive, NULL, prefix);
+	if (root == NULL)
+	{
+		return -1;
+	}
+
+	toc = (const uint8_t*)archive->toc;
+	base = strrchr(prefix, '/');
+	length = base != NULL ? (size_t)(base - prefix) + 1 : 0;
+
+	if (reservePath(&path, &capacity, length) < 0)
+	{
+		return -1;
+	}
+
+	memcpy(path, prefix, length);
+	path[length] = '\0';
+
+	// depth first through the child and sibling links; the path buffer grows and shrinks with the current container
+
+	for (container = root;;)
 	{
 		const char* name;
 		size_t nlen;
+		fa_dirinfo_t info;
+		uint32_t i;
+		int stop = 0;
+
+		for (i = 0; (i < container->entries.count) && !stop; ++i)
+		{
+			const fa_entry_t* entry = ((const fa_entry_t*)(toc + container->entries.offset)) + i;
+
+			if (entry->name == FA_INVALID_OFFSET)
+			{
+				continue;
+			}
+
+			name = (const char*)(toc + entry->name);
+			nlen = strlen(name);
 
-		child = (fa_container_t*)(toc + curr);
-		name = child->name != FA_INVALID_OFFSET ? (const char*)(toc + child->name) : NULL;
-		nlen = name != NULL ? strlen(name) : 0;
+			if (reservePath(&path, &capacity, length + nlen) < 0)
+			{
+				stop = -1;
+				break;
+			}
 
-		if (((size_t)(term - path) == nlen) && !memcmp(name, path, nlen))
+			memcpy(path + length, name, nlen + 1);
+
+			fa_entry_info(archive, entry, &info);
+			stop = callback(path, &info, userdata) ? 1 : 0;
+		}
+
+		if (stop)
 		{
+			result = stop > 0 ? 0 : -1;
 			break;
 		}
 
+		if (container->children != FA_INVALID_OFFSET)
+		{
+			container = (const fa_container_t*)(toc + container->children);
+		}
+		else
+		{
+			while ((container != root) && (container->next == FA_INVALID_OFFSET))
+			{
+				containerName(archive, container, &nlen);
+				length -= nlen + 1;
+
+				container = (const fa_container_t*)(toc + container->parent);
+			}
+
+			if (container == root)
+			{
+				result = 0;
+				break;
+			}
+
+			containerName(archive, container, &nlen);
+			length -= nlen + 1;
+
+			container = (const fa_container_t*)(toc + container->next);
+		}
+
+		name = containerName(archive, container, &nlen);
+
+		if (reservePath(&path, &capacity, length + nlen + 1) < 0)
+		{
+			break;
+		}
+
+		memcpy(path + length, name, nlen);
+		length += nlen;
+		path[length++] = '/';
+		path[length] = '\0';
+
+		memset(&info, 0, sizeof(info));
+		info.name = name;
+		info.type = FA_ENTRY_DIR;
+		info.compression = FA_COMPRESSION_NONE;
+
+		if (callback(path, &info, userdata))
+		{
+			result = 0;
+			break;
+		}
+	}
+
+	free(path);
+	return result;
+}
+
+int fa_query(fa_archive_t* archive, const char* pattern, fa_walk_callback_t callback, void* userdata)
+{
+	fa_query_state_t state;
+	const fa_container_t* root;
+	int result;
+
+	if ((archive == NULL) || (archive->mode != FA_MODE_READ) || (pattern == NULL) || (callback == NULL))
+	{
+		return -1;
+	}
+
+	state.archive = archive;
+	state.callback = callback;
+	state.userdata = userdata;
+	state.path = NULL;
+	state.capacity = 0;
+
+	if (reservePath(&(state.path), &(state.capacity), 0) < 0)
+	{
+		return -1;
+	}
+
+	state.path[0] = '\0';
+
+	// a pattern without any directory component matches file names at any depth
+
+	root = (const fa_container_t*)(((const uint8_t*)archive->toc) + archive->toc->containers.offset);
+	result = queryContainer(&state, root, 0, pattern, strchr(pattern, '/') == NULL);
+
+	free(state.path);
+	return result < 0 ? -1 : 0;
+}
+
+static int reservePath(char** path, size_t* capacity, size_t length)
+{
+	size_t newCapacity = *capacity > 0 ? *capacity : FA_WALK_PATH_SIZE;
+	char* newPath;
+
+	if ((length + 1) <= *capacity)
+	{
+		return 0;
+	}
+
+	while (newCapacity < (length + 1))
+	{
+		newCapacity *= 2;
+	}
+
+	newPath = realloc(*path, newCapacity);
+	if (newPath == NULL)
+	{
+		return -1;
+	}
+
+	*path = newPath;
+	*capacity = newCapacity;
+	return 0;
+}
+
+static const char* containerName(const fa_archive_t* archive, const fa_container_t* container, size_t* length)
+{
+	const char* name = container->name != FA_INVALID_OFFSET ? ((const char*)archive->toc) + container->name : "";
+
+	if (archive->children != NULL)
+	{
+		*length = archive->children[container - (const fa_container_t*)(((const uint8_t*)archive->toc) + archive->toc->containers.offset)].length;
+	}
+	else
+	{
+		*length = strlen(name);
+	}
+
+	return name;
+}
+
+static const fa_container_t* findChild(const fa_archive_t* archive, const fa_container_t* container, const char* name, size_t length)
+{
+	const uint8_t* toc = (const uint8_t*)(archive->toc);
+	const fa_container_t* child;
+	fa_offset_t curr;
+
+	if (archive->children != NULL)
+	{
+		const fa_container_t* containers = (const fa_container_t*)(toc + archive->toc->containers.offset);
+		const fa_container_index_t* index = &(archive->children[container - containers]);
+		uint32_t low, high;
+
+		if ((index->children > archive->toc->containers.count) || (index->count > (archive->toc->containers.count - index->children)))
+		{
+			return NULL;
+		}
+
+		// children are sorted by name; compare against the stored name lengths
+
+		for (low = index->children, high = index->children + index->count; low < high;)
+		{
+			uint32_t mid = low + ((high - low) >> 1);
+			uint32_t nlen = archive->children[mid].length;
+			int result;
+
+			child = &(containers[mid]);
+			result = memcmp(name, toc + child->name, length < nlen ? length : nlen);
+
+			if ((result == 0) && (length == nlen))
+			{
+				return child;
+			}
+
+			if ((result < 0) || ((result == 0) && (length < nlen)))
+			{
+				high = mid;
+			}
+			else
+			{
+				low = mid + 1;
+			}
+		}
+
+		return NULL;
+	}
+
+	for (curr = container->children; curr != FA_INVALID_OFFSET; curr = child->next)
+	{
+		const char* childName;
+		size_t nlen;
+
+		child = (const fa_container_t*)(toc + curr);
+		childName = child->name != FA_INVALID_OFFSET ? (const char*)(toc + child->name) : NULL;
+		nlen = childName != NULL ? strlen(childName) : 0;
+
+		if ((length == nlen) && !memcmp(childName, name, nlen))
+		{
+			return child;
+		}
+	}
+
+	return NULL;
+}
+
+static int queryContainer(fa_query_state_t* state, const fa_container_t* container, size_t length, const char* pattern, int deep)
+{
+	const uint8_t* toc = (const uint8_t*)(state->archive->toc);
+	const char* term = strchr(pattern, '/');
+	size_t plen = term != NULL ? (size_t)(term - pattern) : strlen(pattern);
+	fa_offset_t curr;
+	int result;
+
+	// "**" spans any number of directories, and an empty component (trailing '/') takes everything below
+
+	if ((plen == 2) && (pattern[0] == '*') && (pattern[1] == '*'))
+	{
+		if (term != NULL)
+		{
+			return queryContainer(state, container, length, term + 1, 1);
+		}
+
+		pattern += plen;
+		plen = 0;
+	}
+
+	if ((term == NULL) || (plen == 0))
+	{
+		uint32_t i;
+
+		for (i = 0; i < container->entries.count; ++i)
+		{
+			const fa_entry_t* entry = ((const fa_entry_t*)(toc + container->entries.offset)) + i;
+			const char* name;
+			size_t nlen;
+			fa_dirinfo_t info;
+
+			if (entry->name == FA_INVALID_OFFSET)
+			{
+				continue;
+			}
+
+			name = (const char*)(toc + entry->name);
+
+			if ((plen > 0) && !matchName(pattern, plen, name))
+			{
+				continue;
+			}
+
+			nlen = strlen(name);
+
+			if (reservePath(&(state->path), &(state->capacity), length + nlen) < 0)
+			{
+				return -1;
+			}
+
+			memcpy(state->path + length, name, nlen + 1);
+
+			fa_entry_info(state->archive, entry, &info);
+			if (state->callback(state->path, &info, state->userdata))
+			{
+				return 1;
+			}
+		}
+
+		deep = deep || (plen == 0);
+	}
+	else if (!deep && (strcspn(pattern, "*?") >= plen))
+	{
+		// literal directory name; descend straight into it
+
+		const fa_container_t* child = findChild(state->archive, container, pattern, plen);
+
+		if (child == NULL)
+		{
+			return 0;
+		}
+
+		if (reservePath(&(state->path), &(state->capacity), length + plen + 1) < 0)
+		{
+			return -1;
+		}
+
+		memcpy(state->path + length, pattern, plen);
+		state->path[length + plen] = '/';
+
+		return queryContainer(state, child, length + plen + 1, term + 1, 0);
+	}
+
+	for (curr = container->children; curr != FA_INVALID_OFFSET;)
+	{
+		const fa_container_t* child = (const fa_container_t*)(toc + curr);
+		size_t nlen;
+		const char* name = containerName(state->archive, child, &nlen);
+		int matched = (term != NULL) && (plen > 0) && matchName(pattern, plen, name);
+
 		curr = child->next;
+
+		if (!matched && !deep)
+		{
+			continue;
+		}
+
+		if (reservePath(&(state->path), &(state->capacity), length + nlen + 1) < 0)
+		{
+			return -1;
+		}
+
+		memcpy(state->path + length, name, nlen);
+		state->path[length + nlen] = '/';
+
+		if (matched && ((result = queryContainer(state, child, length + nlen + 1, term + 1, 0)) != 0))
+		{
+			return result;
+		}
+
+		if (deep && ((result = queryContainer(state, child, length + nlen + 1, pattern, 1)) != 0))
+		{
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+static int matchName(const char* pattern, size_t length, const char* name)
+{
+	const char* end = pattern + length;
+	const char* star = NULL;
+	const char* resume = NULL;
+
+	// iterative wildcard match, backtracking to the most recent '*' on mismatch
+
+	while (*name != '\0')
+	{
+		if ((pattern < end) && (*pattern == '*'))
+		{
+			star = ++pattern;
+			resume = name;
+		}
+		else if ((pattern < end) && ((*pattern == '?') || (*pattern == *name)))
+		{
+			++ pattern;
+			++ name;
+		}
+		else if (star != NULL)
+		{
+			pattern = star;
+			name = ++resume;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+
+	while ((pattern < end) && (*pattern == '*'))
+	{
+		++ pattern;
 	}
 
-	return (curr != FA_INVALID_OFFSET) ? fa_find_container(archive, child, term + 1) : NULL;
+	return pattern == end;
 }
@@ -32,7 +32,21 @@ SOFTWARE.
 #pragma warning(disable: 4100 4127)
 #endif
 
+static fa_cache_window_t* acquireWindow(fa_file_t* file);
 static int fillCache(fa_file_t* file, size_t minFill);
+static int loadBlock(fa_file_t* file);
+static int decodeBlock(fa_file_t* file, const uint8_t* source, size_t available, uint8_t* out, uint32_t size);
+static int writeBlock(fa_file_writer_t* writer);
+static int seekBlock(fa_file_t* file, uint32_t block);
+static uint32_t entryIndex(const fa_file_t* file);
+static int locateBlock(const fa_file_t* file, uint32_t block, uint32_t* compressed, uint32_t* original);
+static int decompressBlock(fa_archive_t* archive, fa_codec_t** codec, fa_compression_t compression, const uint8_t* source, size_t available, uint8_t* out, uint32_t size, uint32_t* consumed);
+static uint32_t readBlockHeader(const fa_archive_t* archive, const uint8_t* source, fa_block_ex_t* block);
+static const fa_entry_t* findEntry(const fa_archive_t* archive, const char* filename);
+static const fa_entry_t* findHash(const fa_archive_t* archive, const fa_hash_t* hash);
+static int parseHash(const char* in, fa_hash_t* hash);
+static fa_file_t* openEntry(fa_archive_t* archive, const fa_entry_t* entry);
+static int matchPath(const fa_archive_t* archive, const fa_path_slot_t* slot, const char* path);
 
 fa_file_t* fa_open(fa_archive_t* archive, const char* filename, fa_compression_t compression, fa_dirinfo_t* dirinfo)
 {
@@ -45,95 +59,36 @@ fa_file_t* fa_open(fa_archive_t* archive, const char* filename, fa_compression_t
 	{
 		case FA_MODE_READ:
 		{
-			const fa_container_t* container;
-			const fa_entry_t* begin = NULL;
-			const fa_entry_t* end = NULL;
-			const char* local;
+			const fa_entry_t* entry;
 			fa_file_t* file;
 
 			if (*filename == '@')
 			{
-				do
-				{
-					const char* in = filename + 1;
-					fa_hash_t hash;
-					int i;
-
-					if (strlen(in) != sizeof(hash) * 2)
-					{
-						break;
-					}
-
-					memset(&hash, 0, sizeof(hash));
-					for (i = 0; i < sizeof(hash) * 2; ++i)
-					{
-						char v = *(in++);
-						uint8_t out;
-						if ((v >= '0') && (v <= '9'))
-						{
-							out = v - '0';
-						}
-						else if ((v >= 'A') && (v <= 'F'))
-						{
-							out = 10 + v - 'A';
-						}
-						else if ((v >= 'a') && (v <= 'f'))
-						{
-							out = 10 + v - 'a';
-						}
-						else
-						{
-							break;
-						}
-
-						hash.data[i >> 1] |= out << (((i & 1)^1) << 2);
-					}
-
-					if (i != sizeof(hash) * 2)
-					{
-						break;
-					}
+				fa_hash_t hash;
 
+				if (!parseHash(filename + 1, &hash))
+				{
 					file = fa_open_hash(archive, &hash);
 					if (file != NULL)
 					{
+						fa_entry_info(archive, file->entry, dirinfo);
 						return file;
 					}
 				}
-				while (0);
 			}
 
-			container = fa_find_container(archive, NULL, filename);
-			if (container == NULL)
+			entry = findEntry(archive, filename);
+			if (entry == NULL)
 			{
 				return NULL;
 			}
 
-			local = strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename;
-			for (begin = (fa_entry_t*)(((uint8_t*)archive->toc) + container->entries.offset), end = begin + container->entries.count; begin != end; ++begin)
-			{
-				const char* name = begin->name != FA_INVALID_OFFSET ? ((const char*)archive->toc) + begin->name : NULL;
-				if ((name != NULL) && !strcmp(name, local))
-				{
-					break;
-				}
-			}
-
-			if (begin == end)
+			file = openEntry(archive, entry);
+			if (file != NULL)
 			{
-				return NULL;
+				fa_entry_info(archive, entry, dirinfo);
 			}
 
-			file = malloc(sizeof(fa_file_t) + FA_COMPRESSION_MAX_BLOCK);
-			memset(file, 0, sizeof(fa_file_t));
-
-			file->archive = archive;
-			file->entry = begin;
-
-			file->base = archive->base + begin->data;
-
-			file->buffer.data = (uint8_t*)(file + 1);
-
 			return file;
 		}
 		break;
@@ -148,7 +103,7 @@ fa_file_t* fa_open(fa_archive_t* archive, const char* filename, fa_compression_t
 			char* end;
 			int last;
 
-			if (archive->cache.owner != NULL)
+			if (writer->current != NULL)
 			{
 				return NULL;
 			}
@@ -166,6 +121,8 @@ fa_file_t* fa_open(fa_archive_t* archive, const char* filename, fa_compression_t
 			// TODO: align on block size
 
 			entry = &(writer->entries.data[writer->entries.count++]);
+			memset(entry, 0, sizeof(fa_writer_entry_t));
+
 			entry->path = strdup(filename);
 			entry->container = FA_INVALID_OFFSET;
 			entry->offset = writer->offset.compressed;
@@ -190,15 +147,21 @@ fa_file_t* fa_open(fa_archive_t* archive, const char* filename, fa_compression_t
 			*out = '\0';
 
 			file->file.archive = archive;
-			file->file.buffer.data = malloc(FA_COMPRESSION_MAX_BLOCK);
+			file->file.buffer.data = malloc(archive->blockSize);
 			file->entry = entry;
 
 			SHA1Reset(&(entry->hash));
 
-			archive->cache.owner = &(file->file);
+			writer->current = &(file->file);
 			return &(file->file);
 		}
 		break;
+
+		default:
+		{
+			return NULL;
+		}
+		break;
 	}
 
 	return NULL;
@@ -206,43 +169,298 @@ fa_file_t* fa_open(fa_archive_t* archive, const char* filename, fa_compression_t
 
 fa_file_t* fa_open_hash(fa_archive_t* archive, const fa_hash_t* hash)
 {
-	fa_hash_t* begin;
-	fa_hash_t* curr;
-	fa_file_t* file;
-	int i, n;
+	const fa_entry_t* entry;
 
 	if ((archive == NULL) || (archive->mode != FA_MODE_READ))
 	{
 		return NULL;
 	}
 
-	curr = begin = (fa_hash_t*)(((uint8_t*)archive->toc) + archive->toc->hashes);
-	for (i = 0, n = archive->toc->entries.count; i < n; ++i, ++curr)
+	entry = findHash(archive, hash);
+	if (entry == NULL)
+	{
+		return NULL;
+	}
+
+	return openEntry(archive, entry);
+}
+
+int fa_stat(fa_archive_t* archive, const char* filename, fa_dirinfo_t* info)
+{
+	const fa_entry_t* entry = NULL;
+	fa_hash_t hash;
+
+	if ((archive == NULL) || (archive->mode != FA_MODE_READ) || (filename == NULL))
+	{
+		return -1;
+	}
+
+	if ((*filename == '@') && !parseHash(filename + 1, &hash))
+	{
+		entry = findHash(archive, &hash);
+	}
+
+	if (entry == NULL)
+	{
+		entry = findEntry(archive, filename);
+	}
+
+	if (entry == NULL)
+	{
+		return -1;
+	}
+
+	fa_entry_info(archive, entry, info);
+	return 0;
+}
+
+int fa_stat_hash(fa_archive_t* archive, const fa_hash_t* hash, fa_dirinfo_t* info)
+{
+	const fa_entry_t* entry;
+
+	if ((archive == NULL) || (archive->mode != FA_MODE_READ) || (hash == NULL))
+	{
+		return -1;
+	}
+
+	entry = findHash(archive, hash);
+	if (entry == NULL)
+	{
+		return -1;
+	}
+
+	fa_entry_info(archive, entry, info);
+	return 0;
+}
+
+static int parseHash(const char* in, fa_hash_t* hash)
+{
+	int i;
+
+	if (strlen(in) != sizeof(fa_hash_t) * 2)
+	{
+		return -1;
+	}
+
+	memset(hash, 0, sizeof(fa_hash_t));
+	for (i = 0; i < sizeof(fa_hash_t) * 2; ++i)
 	{
-		if (!memcmp(hash, curr, sizeof(fa_hash_t)))
+		char v = *(in++);
+		uint8_t out;
+		if ((v >= '0') && (v <= '9'))
 		{
-			break;
+			out = v - '0';
+		}
+		else if ((v >= 'A') && (v <= 'F'))
+		{
+			out = 10 + v - 'A';
+		}
+		else if ((v >= 'a') && (v <= 'f'))
+		{
+			out = 10 + v - 'a';
+		}
+		else
+		{
+			return -1;
 		}
+
+		hash->data[i >> 1] |= out << (((i & 1)^1) << 2);
 	}
 
-	if (i == n)
+	return 0;
+}
+
+static const fa_entry_t* findHash(const fa_archive_t* archive, const fa_hash_t* hash)
+{
+	const fa_entry_t* entries = (const fa_entry_t*)(((const uint8_t*)archive->toc) + archive->toc->entries.offset);
+	const fa_hash_t* hashes = (const fa_hash_t*)(((const uint8_t*)archive->toc) + archive->toc->hashes);
+	uint32_t i, n = archive->toc->entries.count;
+
+	if (!fa_bloom_test_hash(archive, hash))
 	{
 		return NULL;
 	}
 
+	if (archive->hashes != NULL)
+	{
+		uint32_t low = 0, high = n;
+
+		// binary search for the first entry carrying the hash
+
+		while (low < high)
+		{
+			uint32_t mid = low + ((high - low) >> 1);
+
+			if ((archive->hashes[mid] >= n) || (memcmp(hashes + archive->hashes[mid], hash, sizeof(fa_hash_t)) < 0))
+			{
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
+			}
+		}
+
+		if ((low == n) || (archive->hashes[low] >= n) || memcmp(hashes + archive->hashes[low], hash, sizeof(fa_hash_t)))
+		{
+			return NULL;
+		}
+
+		return entries + archive->hashes[low];
+	}
+
+	for (i = 0; i < n; ++i)
+	{
+		if (!memcmp(hash, hashes + i, sizeof(fa_hash_t)))
+		{
+			return entries + i;
+		}
+	}
+
+	return NULL;
+}
+
+static fa_file_t* openEntry(fa_archive_t* archive, const fa_entry_t* entry)
+{
+	fa_file_t* file = fa_alloc_file(archive);
 
-	file = malloc(sizeof(fa_file_t) + FA_COMPRESSION_MAX_BLOCK);
-	memset(file, 0, sizeof(fa_file_t));
+	if (file == NULL)
+	{
+		return NULL;
+	}
 
-	file->archive = archive;
-	file->entry = ((fa_entry_t*)(((uint8_t*)archive->toc) + archive->toc->entries.offset)) + i;
+	file->entry = entry;
+	file->base = archive->base + entry->data;
 
-	file->base = archive->base + file->entry->data;
+	// uncompressed entries only need the block buffer once a read is not block aligned
 
-	file->buffer.data = (uint8_t*)(file + 1);
+	if ((entry->compression != FA_COMPRESSION_NONE) && (fa_get_buffer(file) == NULL))
+	{
+		fa_free_file(file);
+		return NULL;
+	}
 
 	return file;
-} 
+}
+
+void fa_entry_info(const fa_archive_t* archive, const fa_entry_t* entry, fa_dirinfo_t* info)
+{
+	const fa_entry_t* entries = (const fa_entry_t*)(((const uint8_t*)archive->toc) + archive->toc->entries.offset);
+	const fa_hash_t* hashes = (const fa_hash_t*)(((const uint8_t*)archive->toc) + archive->toc->hashes);
+
+	if (info == NULL)
+	{
+		return;
+	}
+
+	memset(info, 0, sizeof(fa_dirinfo_t));
+
+	info->name = entry->name != FA_INVALID_OFFSET ? ((const char*)archive->toc) + entry->name : NULL;
+
+	info->type = FA_ENTRY_FILE;
+	info->compression = entry->compression;
+
+	info->size.original = entry->size.original;
+	info->size.compressed = entry->size.compressed;
+
+	info->hash = hashes[entry - entries];
+}
+ 
+
+static const fa_entry_t* findEntry(const fa_archive_t* archive, const char* filename)
+{
+	const fa_entry_t* entries = (const fa_entry_t*)(((const uint8_t*)archive->toc) + archive->toc->entries.offset);
+	const fa_container_t* container;
+	const fa_entry_t* begin;
+	const fa_entry_t* end;
+	const char* local;
+	uint32_t hash = fa_hash_path(filename);
+
+	if (!fa_bloom_test_path(archive, hash))
+	{
+		return NULL;
+	}
+
+	if (archive->paths.slots != NULL)
+	{
+		uint32_t slot;
+
+		for (slot = hash & archive->paths.mask; archive->paths.slots[slot].entry != FA_INVALID_OFFSET; slot = (slot + 1) & archive->paths.mask)
+		{
+			const fa_path_slot_t* curr = &(archive->paths.slots[slot]);
+
+			if ((curr->hash == hash) && (curr->entry < archive->toc->entries.count) && matchPath(archive, curr, filename))
+			{
+				return entries + curr->entry;
+			}
+		}
+
+		return NULL;
+	}
+
+	// no path index; walk the container hierarchy
+
+	container = fa_find_container(archive, NULL, filename);
+	if (container == NULL)
+	{
+		return NULL;
+	}
+
+	local = strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename;
+	for (begin = (const fa_entry_t*)(((const uint8_t*)archive->toc) + container->entries.offset), end = begin + container->entries.count; begin != end; ++begin)
+	{
+		const char* name = begin->name != FA_INVALID_OFFSET ? ((const char*)archive->toc) + begin->name : NULL;
+		if ((name != NULL) && !strcmp(name, local))
+		{
+			return begin;
+		}
+	}
+
+	return NULL;
+}
+
+static int matchPath(const fa_archive_t* archive, const fa_path_slot_t* slot, const char* path)
+{
+	const uint8_t* toc = (const uint8_t*)archive->toc;
+	const fa_entry_t* entry = ((const fa_entry_t*)(toc + archive->toc->entries.offset)) + slot->entry;
+	const fa_container_t* container = slot->container != FA_INVALID_OFFSET ? (const fa_container_t*)(toc + slot->container) : NULL;
+	size_t length = strlen(path);
+	const char* name;
+	size_t nlen;
+
+	if (entry->name == FA_INVALID_OFFSET)
+	{
+		return 0;
+	}
+
+	// compare path components from the entry name up towards the root container
+
+	name = (const char*)(toc + entry->name);
+	nlen = strlen(name);
+
+	if ((nlen > length) || memcmp(path + length - nlen, name, nlen))
+	{
+		return 0;
+	}
+
+	length -= nlen;
+
+	while ((container != NULL) && (container->name != FA_INVALID_OFFSET))
+	{
+		name = (const char*)(toc + container->name);
+		nlen = strlen(name);
+
+		if ((nlen + 1 > length) || (path[length - 1] != '/') || memcmp(path + length - 1 - nlen, name, nlen))
+		{
+			return 0;
+		}
+
+		length -= nlen + 1;
+		container = container->parent != FA_INVALID_OFFSET ? (const fa_container_t*)(toc + container->parent) : NULL;
+	}
+
+	return length == 0;
+}
 
 int fa_close(fa_file_t* file, fa_dirinfo_t* dirinfo)
 {
@@ -251,18 +469,20 @@ int fa_close(fa_file_t* file, fa_dirinfo_t* dirinfo)
 		return -1;
 	}
 
-	if (file->archive->cache.owner == file)
+	fa_async_complete(file);
+	fa_stream_destroy(file);
+	fa_release_window(file);
+
+	if (file->archive->flags & FA_ARCHIVE_FLAG_CONCURRENT)
 	{
-		file->archive->cache.offset = 0;
-		file->archive->cache.fill = 0;
-		file->archive->cache.owner = NULL;
+		free(file->window);
 	}
 
 	switch (file->archive->mode)
 	{
 		case FA_MODE_READ:
 		{
-			free(file);
+			fa_free_file(file);
 			return 0;
 		}
 		break;
@@ -270,57 +490,15 @@ int fa_close(fa_file_t* file, fa_dirinfo_t* dirinfo)
 		case FA_MODE_WRITE:
 		{
 			fa_file_writer_t* writer = (fa_file_writer_t*)file;
-			fa_archive_writer_t* awriter = (fa_archive_writer_t*)file->archive;
 			fa_writer_entry_t* entry = writer->entry;
 			int result = 0;
 
 			SHA1Result(&(entry->hash));
 
-			do
+			if ((writer->file.buffer.fill > 0) && (writeBlock(writer) < 0))
 			{
-				size_t compressedSize;
-				fa_block_t block;
-				uint8_t* data;
-
-				if (writer->file.buffer.fill == 0)
-				{
-					break;
-				}
-
-				compressedSize = fa_compress_block(writer->entry->compression, file->archive->cache.data, FA_ARCHIVE_CACHE_SIZE, writer->file.buffer.data, writer->file.buffer.fill);
-
-				if (compressedSize >= writer->file.buffer.fill)
-				{
-					block.original = (uint16_t)writer->file.buffer.fill;
-					block.compressed = (uint16_t)(FA_COMPRESSION_SIZE_IGNORE | writer->file.buffer.fill);
-					data = writer->file.buffer.data;
-				}
-				else
-				{
-					block.original = (uint16_t)writer->file.buffer.fill;
-					block.compressed = (uint16_t)compressedSize;
-					data = file->archive->cache.data;
-				}
-
-				if (awriter->archive.ops->write(awriter->archive.handle, &block, sizeof(block)) != sizeof(block))
-				{
-					result = -1;
-					break;
-				}
-
-				if (awriter->archive.ops->write(awriter->archive.handle, data, block.compressed & ~FA_COMPRESSION_SIZE_IGNORE) != (size_t)((block.compressed & ~FA_COMPRESSION_SIZE_IGNORE)))
-				{
-					result = -1;
-					break;
-				}
-
-				awriter->offset.original += block.original;
-				awriter->offset.compressed += sizeof(block) + (block.compressed & ~FA_COMPRESSION_SIZE_IGNORE);
-
-				entry->size.original += block.original;
-				entry->size.compressed += sizeof(block) + (block.compressed & ~FA_COMPRESSION_SIZE_IGNORE); 
+				result = -1;
 			}
-			while (0);
 
 			if (dirinfo != NULL)
 			{
@@ -343,12 +521,21 @@ int fa_close(fa_file_t* file, fa_dirinfo_t* dirinfo)
 				}
 			}
 
+			((fa_archive_writer_t*)file->archive)->current = NULL;
+
+			fa_release_codec(file->archive, writer->file.codec);
 			free(writer->file.buffer.data);
 			free(writer);
 
 			return result;
 		}
 		break;
+
+		default:
+		{
+			return -1;
+		}
+		break;
 	}
 
 	return -1;
@@ -384,21 +571,44 @@ size_t fa_read(fa_file_t* file, void* buffer, size_t length)
 			break;
 		}
 
+		if (file->stream != NULL)
+		{
+			totalRead += fa_stream_read(file, buffer, length);
+			break;
+		}
+
 		maxFileRead = file->entry->size.original - file->offset.original;
 		maxBufferRead = maxFileRead & ~(FA_COMPRESSION_MAX_BLOCK-1);
 		maxRawRead = length & ~(FA_COMPRESSION_MAX_BLOCK-1);
 		maxRead = maxRawRead > maxBufferRead ? maxBufferRead : maxRawRead;
 
-		if (file->entry->compression == FA_COMPRESSION_NONE)
+		if ((file->entry->compression == FA_COMPRESSION_NONE) && (file->archive->ops->map != NULL))
 		{
 			fa_archive_t* archive = file->archive;
+			const void* data;
+
+			maxRead = length > maxFileRead ? maxFileRead : length;
 
-			if (archive->ops->lseek(archive->handle, (long)(file->base + file->offset.compressed), FA_SEEK_SET) < 0)
+			data = archive->ops->map(archive->handle, file->base + file->offset.compressed, maxRead);
+			if (data == NULL)
 			{
 				break;
 			}
 
-			if (archive->ops->read(archive->handle, buffer, maxRead) != maxRead)
+			memcpy(buffer, data, maxRead);
+			totalRead += maxRead;
+
+			file->buffer.offset = 0;
+			file->buffer.fill = 0;
+
+			file->offset.original += maxRead;
+			file->offset.compressed += maxRead;
+		}
+		else if (file->entry->compression == FA_COMPRESSION_NONE)
+		{
+			fa_archive_t* archive = file->archive;
+
+			if ((maxRead > 0) && (archive->ops->pread(archive->handle, buffer, maxRead, file->base + file->offset.compressed) != maxRead))
 			{
 				break;
 			}
@@ -415,7 +625,14 @@ size_t fa_read(fa_file_t* file, void* buffer, size_t length)
 
 			maxRead = length > maxFileRead ? maxFileRead : length;
 
-			if (archive->ops->read(archive->handle, file->buffer.data, maxFileRead) != maxFileRead)
+			if (maxFileRead == 0)
+			{
+				file->buffer.offset = 0;
+				file->buffer.fill = 0;
+				break;
+			}
+
+			if ((fa_get_buffer(file) == NULL) || (archive->ops->pread(archive->handle, file->buffer.data, maxFileRead, file->base + file->offset.compressed) != maxFileRead))
 			{
 				break;
 			}
@@ -429,57 +646,27 @@ size_t fa_read(fa_file_t* file, void* buffer, size_t length)
 			file->offset.original += maxFileRead;
 			file->offset.compressed += maxFileRead;
 		}
-		else
+		else if (file->archive->ops->map != NULL)
 		{
-			if (file->archive->cache.owner != file)
+			fa_archive_t* archive = file->archive;
+			size_t maxSourceRead = file->entry->size.compressed - file->offset.compressed;
+			const uint8_t* source = archive->ops->map(archive->handle, file->base + file->offset.compressed, maxSourceRead);
+
+			if (source == NULL)
 			{
-				file->archive->cache.offset = 0;
-				file->archive->cache.fill = 0;
-				file->archive->cache.owner = file;
+				break;
 			}
 
+			totalRead += fa_decode_blocks(file, source, maxSourceRead, buffer, length);
+		}
+		else
+		{
 			length = length > maxFileRead ? maxFileRead : length;
 			while (length > 0)
 			{
-				if (file->buffer.offset == file->buffer.fill)
+				if ((file->buffer.offset == file->buffer.fill) && (loadBlock(file) < 0))
 				{
-					fa_block_t block;
-
-					if (fillCache(file, sizeof(block)) < 0)
-					{
-						break;
-					}
-
-					memcpy(&block, file->archive->cache.data + file->archive->cache.offset, sizeof(block)); 
-
-					if (fillCache(file, sizeof(block) + (block.compressed & ~FA_COMPRESSION_SIZE_IGNORE)) < 0)
-					{
-						break;
-					}
-
-					if (block.original > FA_COMPRESSION_MAX_BLOCK)
-					{
-						break;
-					}
-
-					if (block.compressed & FA_COMPRESSION_SIZE_IGNORE)
-					{
-						memcpy(file->buffer.data, file->archive->cache.data + file->archive->cache.offset + sizeof(block), block.original);
-					}
-					else
-					{
-						if (fa_decompress_block(file->entry->compression, file->buffer.data, block.original, file->archive->cache.data + file->archive->cache.offset + sizeof(block), block.compressed) != block.original)
-						{
-							break;
-						}
-					}
-
-					file->archive->cache.offset += sizeof(block) + (block.compressed & ~FA_COMPRESSION_SIZE_IGNORE);
-					file->offset.compressed += sizeof(block) + (block.compressed & ~FA_COMPRESSION_SIZE_IGNORE);
-					file->offset.original += block.original;
-
-					file->buffer.offset = 0;
-					file->buffer.fill = block.original;
+					break;
 				}
 
 				maxRead = length > file->buffer.fill - file->buffer.offset ? file->buffer.fill - file->buffer.offset : length;
@@ -503,10 +690,592 @@ size_t fa_read(fa_file_t* file, void* buffer, size_t length)
 	return totalRead;
 }
 
-static int fillCache(fa_file_t* file, size_t minFill)
+size_t fa_pread(fa_file_t* file, void* buffer, size_t length, uint64_t offset)
 {
-	fa_archive_t* archive = file->archive;
-	size_t cacheFill = archive->cache.fill - archive->cache.offset;
+	const fa_archive_t* archive;
+	uint8_t* scratch = NULL;
+	fa_codec_t* codec = NULL;
+	size_t totalRead = 0;
+	uint32_t compressed = 0, original = 0;
+
+	if ((file == NULL) || (file->archive->mode != FA_MODE_READ) || (offset >= file->entry->size.original))
+	{
+		return 0;
+	}
+
+	archive = file->archive;
+	length = length > (file->entry->size.original - offset) ? (size_t)(file->entry->size.original - offset) : length;
+
+	if (file->entry->compression == FA_COMPRESSION_NONE)
+	{
+		const void* data = archive->ops->map != NULL ? archive->ops->map(archive->handle, file->base + offset, length) : NULL;
+
+		if (data != NULL)
+		{
+			memcpy(buffer, data, length);
+			return length;
+		}
+
+		return archive->ops->pread(archive->handle, buffer, length, file->base + offset);
+	}
+
+	if ((file->entry->blockSize == 0) || (locateBlock(file, (uint32_t)(offset / file->entry->blockSize), &compressed, &original) < 0))
+	{
+		return 0;
+	}
+
+	// decode block by block using local state only; file offsets and buffers are left untouched
+
+	while (length > 0)
+	{
+		uint32_t skip = (uint32_t)(offset - original);
+		uint32_t expected = file->entry->size.original - original;
+		uint32_t consumed;
+		size_t maxRead;
+		uint8_t* out;
+		int decoded;
+
+		expected = expected > file->entry->blockSize ? file->entry->blockSize : expected;
+
+		// whole blocks are decoded straight into the destination
+
+		if ((skip == 0) && (length >= expected))
+		{
+			out = buffer;
+		}
+		else
+		{
+			scratch = scratch != NULL ? scratch : malloc(archive->blockSize + archive->blockHeader + archive->blockSize);
+			if (scratch == NULL)
+			{
+				break;
+			}
+
+			out = scratch;
+		}
+
+		decoded = fa_load_block(file, compressed, original, out, expected, &scratch, &codec, &consumed);
+		if ((decoded <= 0) || ((uint32_t)decoded <= skip))
+		{
+			break;
+		}
+
+		maxRead = length > (decoded - skip) ? (decoded - skip) : length;
+		if (out != buffer)
+		{
+			memcpy(buffer, out + skip, maxRead);
+		}
+
+		buffer = ((uint8_t*)buffer) + maxRead;
+		length -= maxRead;
+		totalRead += maxRead;
+		offset += maxRead;
+
+		compressed += consumed;
+		original += decoded;
+	}
+
+	free(scratch);
+	fa_release_codec(file->archive, codec);
+
+	return totalRead;
+}
+
+int fa_load_block(const fa_file_t* file, uint32_t compressed, uint32_t original, uint8_t* out, uint32_t size, uint8_t** scratch, fa_codec_t** codec, uint32_t* consumed)
+{
+	const fa_archive_t* archive = file->archive;
+	size_t maxSourceRead = file->entry->size.compressed - compressed;
+	const uint8_t* source = NULL;
+	int decoded;
+
+	decoded = fa_block_cache_read(file->archive, entryIndex(file), original / file->entry->blockSize, out, size, consumed);
+	if (decoded >= 0)
+	{
+		return decoded;
+	}
+
+	maxSourceRead = maxSourceRead > (archive->blockHeader + archive->blockSize) ? (archive->blockHeader + archive->blockSize) : maxSourceRead;
+
+	if (archive->ops->map != NULL)
+	{
+		source = archive->ops->map(archive->handle, file->base + compressed, maxSourceRead);
+	}
+
+	if (source == NULL)
+	{
+		// scratch holds a decoded block followed by the compressed source
+
+		*scratch = *scratch != NULL ? *scratch : malloc(archive->blockSize + archive->blockHeader + archive->blockSize);
+		if (*scratch == NULL)
+		{
+			return -1;
+		}
+
+		if (archive->ops->pread(archive->handle, *scratch + archive->blockSize, maxSourceRead, file->base + compressed) != maxSourceRead)
+		{
+			return -1;
+		}
+
+		source = *scratch + archive->blockSize;
+	}
+
+	decoded = decompressBlock(file->archive, codec, file->entry->compression, source, maxSourceRead, out, size, consumed);
+	if (decoded > 0)
+	{
+		fa_block_cache_write(file->archive, entryIndex(file), original / file->entry->blockSize, out, decoded, *consumed);
+	}
+
+	return decoded;
+}
+
+size_t fa_decode_blocks(fa_file_t* file, const uint8_t* source, size_t sourceSize, void* buffer, size_t length)
+{
+	size_t totalRead = 0;
+	size_t sourceOffset = 0;
+
+	while (length > 0)
+	{
+		size_t maxRead;
+
+		if (file->buffer.offset == file->buffer.fill)
+		{
+			uint32_t maxFileRead = file->entry->size.original - file->offset.original;
+			uint32_t start = file->offset.compressed;
+			int decoded;
+
+			// whole blocks are decoded straight into the destination
+
+			if (length >= (maxFileRead > file->entry->blockSize ? file->entry->blockSize : maxFileRead))
+			{
+				decoded = decodeBlock(file, source + sourceOffset, sourceSize - sourceOffset, buffer, length > file->entry->blockSize ? file->entry->blockSize : (uint32_t)length);
+				if (decoded <= 0)
+				{
+					break;
+				}
+
+				sourceOffset += file->offset.compressed - start;
+
+				// the file buffer no longer holds the block preceding the file offset
+
+				file->buffer.offset = 0;
+				file->buffer.fill = 0;
+
+				buffer = ((uint8_t*)buffer) + decoded;
+				length -= decoded;
+				totalRead += decoded;
+				continue;
+			}
+
+			decoded = decodeBlock(file, source + sourceOffset, sourceSize - sourceOffset, file->buffer.data, file->archive->blockSize);
+			if (decoded <= 0)
+			{
+				break;
+			}
+
+			sourceOffset += file->offset.compressed - start;
+
+			file->buffer.offset = 0;
+			file->buffer.fill = decoded;
+		}
+
+		maxRead = length > file->buffer.fill - file->buffer.offset ? file->buffer.fill - file->buffer.offset : length;
+		if (maxRead == 0)
+		{
+			break;
+		}
+
+		memcpy(buffer, file->buffer.data + file->buffer.offset, maxRead);
+
+		buffer = ((uint8_t*)buffer) + maxRead;
+		length -= maxRead;
+		totalRead += maxRead;
+
+		file->buffer.offset += maxRead;
+	}
+
+	return totalRead;
+}
+
+static int decodeBlock(fa_file_t* file, const uint8_t* source, size_t available, uint8_t* out, uint32_t size)
+{
+	uint32_t block = file->offset.original / file->entry->blockSize;
+	uint32_t consumed;
+	int decoded;
+
+	if (file->offset.original >= file->entry->size.original)
+	{
+		return -1;
+	}
+
+	decoded = fa_block_cache_read(file->archive, entryIndex(file), block, out, size, &consumed);
+	if (decoded < 0)
+	{
+		decoded = decompressBlock(file->archive, &(file->codec), file->entry->compression, source, available, out, size, &consumed);
+		if (decoded > 0)
+		{
+			fa_block_cache_write(file->archive, entryIndex(file), block, out, decoded, consumed);
+		}
+	}
+
+	if (decoded >= 0)
+	{
+		file->offset.compressed += consumed;
+		file->offset.original += decoded;
+	}
+
+	return decoded;
+}
+
+static int decompressBlock(fa_archive_t* archive, fa_codec_t** codec, fa_compression_t compression, const uint8_t* source, size_t available, uint8_t* out, uint32_t size, uint32_t* consumed)
+{
+	fa_block_ex_t block;
+	uint32_t header;
+
+	if (available < archive->blockHeader)
+	{
+		return -1;
+	}
+
+	header = readBlockHeader(archive, source, &block);
+
+	if (((block.compressed & ~FA_COMPRESSION_SIZE_IGNORE_EX) > available - header) || (block.original > size))
+	{
+		return -1;
+	}
+
+	if (block.compressed & FA_COMPRESSION_SIZE_IGNORE_EX)
+	{
+		if ((block.compressed & ~FA_COMPRESSION_SIZE_IGNORE_EX) != block.original)
+		{
+			return -1;
+		}
+
+		memcpy(out, source + header, block.original);
+	}
+	else
+	{
+		size_t decoded;
+
+		// the codec is kept by the caller across blocks, so the pool is only visited once per reader
+
+		*codec = *codec != NULL ? *codec : fa_acquire_codec(archive);
+		if (*codec == NULL)
+		{
+			return -1;
+		}
+
+		decoded = fa_decompress_block(*codec, compression, archive->dictionary, out, block.original, source + header, block.compressed);
+
+		if (decoded != block.original)
+		{
+			return -1;
+		}
+	}
+
+	*consumed = header + (block.compressed & ~FA_COMPRESSION_SIZE_IGNORE_EX);
+
+	return (int)block.original;
+}
+
+static uint32_t readBlockHeader(const fa_archive_t* archive, const uint8_t* source, fa_block_ex_t* block)
+{
+	fa_block_t header;
+
+	if (archive->blockHeader == sizeof(fa_block_ex_t))
+	{
+		memcpy(block, source, sizeof(fa_block_ex_t));
+		return sizeof(fa_block_ex_t);
+	}
+
+	// widen 16-bit headers so callers only deal with one layout
+
+	memcpy(&header, source, sizeof(header));
+
+	block->original = header.original;
+	block->compressed = header.compressed & ~FA_COMPRESSION_SIZE_IGNORE;
+
+	if (header.compressed & FA_COMPRESSION_SIZE_IGNORE)
+	{
+		block->compressed |= FA_COMPRESSION_SIZE_IGNORE_EX;
+	}
+
+	return sizeof(fa_block_t);
+}
+
+static int loadBlock(fa_file_t* file)
+{
+	fa_archive_t* archive = file->archive;
+	uint32_t start = file->offset.compressed;
+	uint32_t consumed;
+	int decoded;
+
+	if (file->offset.original >= file->entry->size.original)
+	{
+		return -1;
+	}
+
+	decoded = fa_block_cache_read(archive, entryIndex(file), file->offset.original / file->entry->blockSize, file->buffer.data, archive->blockSize, &consumed);
+	if (decoded >= 0)
+	{
+		fa_cache_window_t* window = file->window;
+
+		// cached blocks need no I/O; keep the read-ahead window in step with the file
+
+		if ((window != NULL) && (window->owner == file) && ((window->fill - window->offset) >= consumed))
+		{
+			window->offset += consumed;
+		}
+		else
+		{
+			fa_release_window(file);
+		}
+
+		file->offset.compressed += consumed;
+		file->offset.original += decoded;
+	}
+	else if (archive->ops->map != NULL)
+	{
+		size_t maxSourceRead = file->entry->size.compressed - file->offset.compressed;
+		const uint8_t* source;
+
+		maxSourceRead = maxSourceRead > (archive->blockHeader + archive->blockSize) ? (archive->blockHeader + archive->blockSize) : maxSourceRead;
+
+		source = archive->ops->map(archive->handle, file->base + file->offset.compressed, maxSourceRead);
+		if (source == NULL)
+		{
+			return -1;
+		}
+
+		decoded = decodeBlock(file, source, maxSourceRead, file->buffer.data, archive->blockSize);
+	}
+	else
+	{
+		fa_cache_window_t* window = acquireWindow(file);
+		fa_block_ex_t block;
+		uint32_t header;
+
+		if (window == NULL)
+		{
+			return -1;
+		}
+
+		if (fillCache(file, archive->blockHeader) < 0)
+		{
+			return -1;
+		}
+
+		header = readBlockHeader(archive, window->data + window->offset, &block);
+
+		if (((block.compressed & ~FA_COMPRESSION_SIZE_IGNORE_EX) > archive->blockSize) || (fillCache(file, header + (block.compressed & ~FA_COMPRESSION_SIZE_IGNORE_EX)) < 0))
+		{
+			return -1;
+		}
+
+		decoded = decodeBlock(file, window->data + window->offset, window->fill - window->offset, file->buffer.data, archive->blockSize);
+		if (decoded >= 0)
+		{
+			window->offset += file->offset.compressed - start;
+		}
+	}
+
+	if (decoded < 0)
+	{
+		return -1;
+	}
+
+	file->buffer.offset = 0;
+	file->buffer.fill = decoded;
+
+	return 0;
+}
+
+static int seekBlock(fa_file_t* file, uint32_t block)
+{
+	uint32_t compressed = file->offset.compressed;
+	uint32_t original = file->offset.original;
+
+	fa_release_window(file);
+
+	file->buffer.offset = 0;
+	file->buffer.fill = 0;
+
+	if (locateBlock(file, block, &compressed, &original) < 0)
+	{
+		return -1;
+	}
+
+	file->offset.compressed = compressed;
+	file->offset.original = original;
+
+	return 0;
+}
+
+static uint32_t entryIndex(const fa_file_t* file)
+{
+	const fa_header_t* toc = file->archive->toc;
+	return (uint32_t)(file->entry - (const fa_entry_t*)(((const uint8_t*)toc) + toc->entries.offset));
+}
+
+static int locateBlock(const fa_file_t* file, uint32_t block, uint32_t* compressed, uint32_t* original)
+{
+	const fa_archive_t* archive = file->archive;
+	uint32_t first = archive->blocks.first != NULL ? archive->blocks.first[entryIndex(file)] : FA_INVALID_OFFSET;
+	uint32_t target = block * file->entry->blockSize;
+
+	if (target >= file->entry->size.original)
+	{
+		*compressed = file->entry->size.compressed;
+		*original = file->entry->size.original;
+		return 0;
+	}
+
+	if (first != FA_INVALID_OFFSET)
+	{
+		if ((first >= archive->blocks.count) || (block >= archive->blocks.count - first))
+		{
+			return -1;
+		}
+
+		*compressed = archive->blocks.offsets[first + block];
+		*original = target;
+		return 0;
+	}
+
+	// no index available (version 1 archive), walk the block headers from the given position
+
+	if (target < *original)
+	{
+		*compressed = 0;
+		*original = 0;
+	}
+
+	while (*original < target)
+	{
+		uint8_t data[sizeof(fa_block_ex_t)];
+		fa_block_ex_t header;
+		uint32_t size;
+
+		if (archive->ops->pread(archive->handle, data, archive->blockHeader, file->base + *compressed) != archive->blockHeader)
+		{
+			return -1;
+		}
+
+		size = readBlockHeader(archive, data, &header);
+
+		if (header.original == 0)
+		{
+			return -1;
+		}
+
+		if (*original + header.original > target)
+		{
+			break;
+		}
+
+		*compressed += size + (header.compressed & ~FA_COMPRESSION_SIZE_IGNORE_EX);
+		*original += header.original;
+	}
+
+	return 0;
+}
+
+static fa_cache_window_t* acquireWindow(fa_file_t* file)
+{
+	fa_archive_t* archive = file->archive;
+	fa_cache_window_t* window = file->window;
+	uint32_t i;
+
+	if (archive->flags & FA_ARCHIVE_FLAG_CONCURRENT)
+	{
+		// concurrent readers never share windows; the window lives until the file is closed
+
+		if (window == NULL)
+		{
+			window = malloc(sizeof(fa_cache_window_t) + archive->cache.size);
+			if (window == NULL)
+			{
+				return NULL;
+			}
+
+			window->offset = 0;
+			window->fill = 0;
+			window->data = (uint8_t*)(window + 1);
+			window->owner = file;
+			window->used = 0;
+
+			file->window = window;
+		}
+
+		return window;
+	}
+
+	if ((window == NULL) || (window->owner != file))
+	{
+		// take over an unused window, or evict the least recently used one
+
+		window = &(archive->cache.windows[0]);
+		for (i = 0; (i < FA_ARCHIVE_CACHE_WINDOWS) && (window->owner != NULL); ++i)
+		{
+			fa_cache_window_t* candidate = &(archive->cache.windows[i]);
+
+			if ((candidate->owner == NULL) || ((archive->cache.clock - candidate->used) > (archive->cache.clock - window->used)))
+			{
+				window = candidate;
+			}
+		}
+
+		if (window->data == NULL)
+		{
+			window->data = malloc(archive->cache.size);
+			if (window->data == NULL)
+			{
+				return NULL;
+			}
+		}
+
+		if (window->owner != NULL)
+		{
+			window->owner->window = NULL;
+		}
+
+		window->offset = 0;
+		window->fill = 0;
+		window->owner = file;
+
+		file->window = window;
+	}
+
+	window->used = ++archive->cache.clock;
+
+	return window;
+}
+
+void fa_release_window(fa_file_t* file)
+{
+	fa_cache_window_t* window = file->window;
+
+	if ((window != NULL) && (file->archive->flags & FA_ARCHIVE_FLAG_CONCURRENT))
+	{
+		window->offset = 0;
+		window->fill = 0;
+		return;
+	}
+
+	if ((window != NULL) && (window->owner == file))
+	{
+		window->offset = 0;
+		window->fill = 0;
+		window->owner = NULL;
+	}
+
+	file->window = NULL;
+}
+
+static int fillCache(fa_file_t* file, size_t minFill)
+{
+	fa_archive_t* archive = file->archive;
+	fa_cache_window_t* window = file->window;
+	size_t cacheFill = window->fill - window->offset;
 	size_t cacheMax, fileMax;
 	size_t maxRead;
 
@@ -515,32 +1284,55 @@ static int fillCache(fa_file_t* file, size_t minFill)
 		return 0;
 	}
 
-	cacheMax = FA_ARCHIVE_CACHE_SIZE - cacheFill;
-	fileMax = file->entry->size.compressed - file->offset.compressed;
+	cacheMax = archive->cache.size - cacheFill;
+	fileMax = file->entry->size.compressed - file->offset.compressed - cacheFill;
 	maxRead = cacheMax > fileMax ? fileMax : cacheMax;
 
-	memmove(archive->cache.data, archive->cache.data + archive->cache.offset, cacheFill);
+	memmove(window->data, window->data + window->offset, cacheFill);
 
-	archive->cache.offset = 0;
-	archive->cache.fill = cacheFill;
+	window->offset = 0;
+	window->fill = cacheFill;
 
-	if (archive->ops->lseek(archive->handle, file->base + file->offset.compressed, FA_SEEK_SET) < 0)
+	if (archive->ops->pread(archive->handle, window->data + cacheFill, maxRead, file->base + file->offset.compressed + cacheFill) != maxRead)
 	{
 		return -1;
 	}
 
-	if (archive->ops->read(archive->handle, archive->cache.data + cacheFill, maxRead) != maxRead)
+	window->fill += maxRead;
+
+	if (window->fill < minFill)
 	{
 		return -1;
 	}
 
-	archive->cache.fill += maxRead;
+	return 0;
+}
+
+int fa_map(fa_file_t* file, const void** data, size_t* length)
+{
+	fa_archive_t* archive;
+	const void* mapped;
+
+	if ((file == NULL) || (file->archive->mode != FA_MODE_READ) || (file->entry->compression != FA_COMPRESSION_NONE))
+	{
+		return -1;
+	}
 
-	if (archive->cache.fill < minFill)
+	archive = file->archive;
+	if (archive->ops->map == NULL)
 	{
 		return -1;
 	}
 
+	mapped = archive->ops->map(archive->handle, file->base, file->entry->size.original);
+	if (mapped == NULL)
+	{
+		return -1;
+	}
+
+	*data = mapped;
+	*length = file->entry->size.original;
+
 	return 0;
 }
 
@@ -578,7 +1370,7 @@ size_t fa_write(fa_file_t* file, const void* buffer, size_t length)
 
 		while (length > 0)
 		{
-			size_t bufferMax = FA_COMPRESSION_MAX_BLOCK - writer->file.buffer.fill;
+			size_t bufferMax = awriter->archive.blockSize - writer->file.buffer.fill;
 			size_t maxWrite = length > bufferMax ? bufferMax : length;
 
 			memcpy(writer->file.buffer.data + writer->file.buffer.fill, buffer, maxWrite);
@@ -586,42 +1378,9 @@ size_t fa_write(fa_file_t* file, const void* buffer, size_t length)
 			buffer = ((uint8_t*)buffer) + maxWrite;
 			writer->file.buffer.fill += maxWrite;
 
-			if (writer->file.buffer.fill == FA_COMPRESSION_MAX_BLOCK)
+			if ((writer->file.buffer.fill == awriter->archive.blockSize) && (writeBlock(writer) < 0))
 			{
-				size_t compressedSize = fa_compress_block(writer->entry->compression, file->archive->cache.data, FA_ARCHIVE_CACHE_SIZE, writer->file.buffer.data, FA_COMPRESSION_MAX_BLOCK);
-				fa_block_t block;
-				uint8_t* data;
-
-				if (compressedSize >= FA_COMPRESSION_MAX_BLOCK)
-				{
-					block.original = FA_COMPRESSION_MAX_BLOCK;
-					block.compressed = FA_COMPRESSION_SIZE_IGNORE | FA_COMPRESSION_MAX_BLOCK;
-					data = writer->file.buffer.data;
-				}
-				else
-				{
-					block.original = FA_COMPRESSION_MAX_BLOCK;
-					block.compressed = (uint16_t)compressedSize;
-					data = file->archive->cache.data;
-				}
-
-				if (awriter->archive.ops->write(awriter->archive.handle, &block, sizeof(block)) != sizeof(block))
-				{
-					break;
-				}
-
-				if (awriter->archive.ops->write(awriter->archive.handle, data, block.compressed & ~FA_COMPRESSION_SIZE_IGNORE) != (size_t)((block.compressed & ~FA_COMPRESSION_SIZE_IGNORE)))
-				{
-					break;
-				}
-
-				awriter->offset.original += block.original;
-				awriter->offset.compressed += sizeof(block) + (block.compressed & ~FA_COMPRESSION_SIZE_IGNORE);
-
-				writer->file.buffer.fill = 0;
-
-				writer->entry->size.original += block.original;
-				writer->entry->size.compressed += sizeof(block) + (block.compressed & ~FA_COMPRESSION_SIZE_IGNORE); 
+				break;
 			}
 
 			length -= maxWrite;
@@ -633,6 +1392,77 @@ size_t fa_write(fa_file_t* file, const void* buffer, size_t length)
 	return written;
 }
 
+static int writeBlock(fa_file_writer_t* writer)
+{
+	fa_archive_writer_t* awriter = (fa_archive_writer_t*)writer->file.archive;
+	fa_writer_entry_t* entry = writer->entry;
+	uint32_t fill = writer->file.buffer.fill;
+	uint8_t* out = awriter->compressed.data != NULL ? awriter->compressed.data : awriter->archive.cache.data;
+	size_t outSize = awriter->compressed.data != NULL ? awriter->compressed.size : awriter->archive.cache.size;
+	size_t compressedSize;
+	uint32_t stored, header;
+	uint8_t* data;
+
+	union
+	{
+		fa_block_t block;
+		fa_block_ex_t ex;
+	} block;
+
+	writer->file.codec = writer->file.codec != NULL ? writer->file.codec : fa_acquire_codec(&(awriter->archive));
+	compressedSize = fa_compress_block(writer->file.codec, entry->compression, awriter->options.level, awriter->archive.dictionary, out, outSize, writer->file.buffer.data, fill);
+
+	if (compressedSize >= fill)
+	{
+		stored = fill;
+		data = writer->file.buffer.data;
+	}
+	else
+	{
+		stored = (uint32_t)compressedSize;
+		data = out;
+	}
+
+	header = awriter->archive.blockHeader;
+	if (header == sizeof(fa_block_ex_t))
+	{
+		block.ex.original = fill;
+		block.ex.compressed = data == out ? stored : (FA_COMPRESSION_SIZE_IGNORE_EX | stored);
+	}
+	else
+	{
+		block.block.original = (uint16_t)fill;
+		block.block.compressed = (uint16_t)(data == out ? stored : (FA_COMPRESSION_SIZE_IGNORE | stored));
+	}
+
+	if (entry->blocks.count == entry->blocks.capacity)
+	{
+		entry->blocks.capacity = (entry->blocks.capacity * 2) < 16 ? 16 : entry->blocks.capacity * 2;
+		entry->blocks.data = realloc(entry->blocks.data, entry->blocks.capacity * sizeof(uint32_t));
+	}
+
+	entry->blocks.data[entry->blocks.count++] = entry->size.compressed;
+
+	if (awriter->archive.ops->write(awriter->archive.handle, &block, header) != header)
+	{
+		return -1;
+	}
+
+	if (awriter->archive.ops->write(awriter->archive.handle, data, stored) != stored)
+	{
+		return -1;
+	}
+
+	awriter->offset.original += fill;
+	awriter->offset.compressed += header + stored;
+
+	entry->size.original += fill;
+	entry->size.compressed += header + stored;
+
+	writer->file.buffer.fill = 0;
+	return 0;
+}
+
 int fa_lseek(fa_file_t* file, int64_t offset, fa_seek_t whence)
 {
 	uint32_t fixedOffset;
@@ -642,6 +1472,11 @@ int fa_lseek(fa_file_t* file, int64_t offset, fa_seek_t whence)
 		return -1;
 	}
 
+	if (file->stream != NULL)
+	{
+		return fa_stream_seek(file, offset, whence);
+	}
+
 	switch (whence)
 	{
 		case FA_SEEK_SET:
@@ -652,7 +1487,7 @@ int fa_lseek(fa_file_t* file, int64_t offset, fa_seek_t whence)
 
 		case FA_SEEK_CURR:
 		{
-			fixedOffset = (uint32_t)(file->offset.original + offset);
+			fixedOffset = (uint32_t)(fa_tell(file) + offset);
 		}
 		break;
 
@@ -684,12 +1519,7 @@ int fa_lseek(fa_file_t* file, int64_t offset, fa_seek_t whence)
 
 		if (alignedOffset != fixedOffset)
 		{
-			if (archive->ops->lseek(archive->handle, file->base + alignedOffset, FA_SEEK_SET) < 0)
-			{
-				return -1;
-			}
-
-			if (archive->ops->read(archive->handle, file->buffer.data, maxFileRead) != maxFileRead)
+			if ((fa_get_buffer(file) == NULL) || (archive->ops->pread(archive->handle, file->buffer.data, maxFileRead, file->base + alignedOffset) != maxFileRead))
 			{
 				return -1;
 			}
@@ -706,10 +1536,39 @@ int fa_lseek(fa_file_t* file, int64_t offset, fa_seek_t whence)
 	}
 	else
 	{
-		// TODO: implement seeking inside compressed files
+		uint32_t bufferStart = file->offset.original - file->buffer.fill;
+		uint32_t blockSize = file->entry->blockSize;
+
+		if ((fixedOffset >= bufferStart) && (fixedOffset < file->offset.original))
+		{
+			file->buffer.offset = fixedOffset - bufferStart;
+			return 0;
+		}
+
+		if ((blockSize == 0) || (seekBlock(file, fixedOffset / blockSize) < 0))
+		{
+			return -1;
+		}
+
+		if (fixedOffset > file->offset.original)
+		{
+			uint32_t skip = fixedOffset - file->offset.original;
+
+			if (loadBlock(file) < 0)
+			{
+				return -1;
+			}
+
+			if (skip > file->buffer.fill)
+			{
+				return -1;
+			}
+
+			file->buffer.offset = skip;
+		}
 	}
 
-	return -1;
+	return 0;
 }
 
 size_t fa_tell(fa_file_t* file)
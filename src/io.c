@@ -24,23 +24,68 @@ SOFTWARE.
 
 #include <filearchive/internal/api.h>
 
-static fa_io_handle_t fa_io_open(const char* filename, fa_mode_t mode);
+#include <stdlib.h>
+#include <string.h>
+
+static fa_io_handle_t fa_io_open(const char* filename, fa_mode_t mode, void* context);
 static int fa_io_close(fa_io_handle_t handle);
 
 static size_t fa_io_read(fa_io_handle_t handle, void* buffer, size_t length);
+static size_t fa_io_pread(fa_io_handle_t handle, void* buffer, size_t length, uint64_t offset);
 static size_t fa_io_write(fa_io_handle_t handle, const void* buffer, size_t length);
 
 static int fa_io_lseek(fa_io_handle_t handle, int64_t offset, fa_seek_t whence);
 static size_t fa_io_tell(fa_io_handle_t handle);
 
+static fa_io_handle_t fa_io_mapped_open(const char* filename, fa_mode_t mode, void* context);
+static int fa_io_mapped_close(fa_io_handle_t handle);
+
+static size_t fa_io_mapped_read(fa_io_handle_t handle, void* buffer, size_t length);
+static size_t fa_io_mapped_pread(fa_io_handle_t handle, void* buffer, size_t length, uint64_t offset);
+static size_t fa_io_mapped_write(fa_io_handle_t handle, const void* buffer, size_t length);
+
+static int fa_io_mapped_lseek(fa_io_handle_t handle, int64_t offset, fa_seek_t whence);
+static size_t fa_io_mapped_tell(fa_io_handle_t handle);
+
+static const void* fa_io_mapped_map(fa_io_handle_t handle, uint64_t offset, size_t length);
+
+static fa_io_handle_t fa_io_memory_open(const char* filename, fa_mode_t mode, void* context);
+static int fa_io_memory_close(fa_io_handle_t handle);
+
 static fa_io_ops_t fa_io_default_ops =
 {
 	fa_io_open,
 	fa_io_close,
 	fa_io_read,
+	fa_io_pread,
 	fa_io_write,
 	fa_io_lseek,
-	fa_io_tell
+	fa_io_tell,
+	NULL
+};
+
+static fa_io_ops_t fa_io_mapped_ops =
+{
+	fa_io_mapped_open,
+	fa_io_mapped_close,
+	fa_io_mapped_read,
+	fa_io_mapped_pread,
+	fa_io_mapped_write,
+	fa_io_mapped_lseek,
+	fa_io_mapped_tell,
+	fa_io_mapped_map
+};
+
+static fa_io_ops_t fa_io_memory_ops =
+{
+	fa_io_memory_open,
+	fa_io_memory_close,
+	fa_io_mapped_read,
+	fa_io_mapped_pread,
+	fa_io_mapped_write,
+	fa_io_mapped_lseek,
+	fa_io_mapped_tell,
+	fa_io_mapped_map
 };
 
 const fa_io_ops_t* fa_get_default_ops()
@@ -48,16 +93,24 @@ const fa_io_ops_t* fa_get_default_ops()
 	return &fa_io_default_ops;
 }
 
+const fa_io_ops_t* fa_get_mapped_ops()
+{
+	return &fa_io_mapped_ops;
+}
+
+const fa_io_ops_t* fa_get_memory_ops()
+{
+	return &fa_io_memory_ops;
+}
+
 #if defined(__unix__) || defined(__APPLE__) 
 
 #include <fcntl.h>
 #include <unistd.h>
-
-#if defined(__OpenBSD__)
+#include <sys/mman.h>
 #include <sys/stat.h>
-#endif
 
-fa_io_handle_t fa_io_open(const char* filename, fa_mode_t mode)
+fa_io_handle_t fa_io_open(const char* filename, fa_mode_t mode, void* context)
 {
 	int oflags[2] = { O_RDONLY, O_WRONLY|O_CREAT|O_TRUNC }; 	
 	intptr_t fd = open(filename, oflags[mode], S_IRWXU|S_IRGRP|S_IROTH); 
@@ -77,6 +130,13 @@ size_t fa_io_read(fa_io_handle_t handle, void* buffer, size_t length)
 	return result < 0 ? 0 : result;
 }
 
+size_t fa_io_pread(fa_io_handle_t handle, void* buffer, size_t length, uint64_t offset)
+{
+	intptr_t fd = (intptr_t)handle;
+	ssize_t result = pread(fd, buffer, length, (off_t)offset);
+	return result < 0 ? 0 : result;
+}
+
 size_t fa_io_write(fa_io_handle_t handle, const void* buffer, size_t length)
 {
 	intptr_t fd = (intptr_t)handle;
@@ -97,10 +157,60 @@ size_t fa_io_tell(fa_io_handle_t handle)
 	off_t result = lseek(fd, 0, SEEK_CUR);
 	return result < 0 ? 0 : result; 
 }
+
+fa_io_handle_t fa_io_mapped_open(const char* filename, fa_mode_t mode, void* context)
+{
+	fa_io_mapping_t* mapping = NULL;
+	struct stat fs;
+	void* data;
+	int fd;
+
+	if (mode != FA_MODE_READ)
+	{
+		return FA_IO_INVALID_HANDLE;
+	}
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		return FA_IO_INVALID_HANDLE;
+	}
+
+	do
+	{
+		if ((fstat(fd, &fs) < 0) || (fs.st_size == 0))
+		{
+			break;
+		}
+
+		data = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			break;
+		}
+
+		mapping = malloc(sizeof(fa_io_mapping_t));
+		mapping->data = data;
+		mapping->size = fs.st_size;
+		mapping->offset = 0;
+	}
+	while (0);
+
+	close(fd);
+	return mapping != NULL ? (fa_io_handle_t)mapping : FA_IO_INVALID_HANDLE;
+}
+
+int fa_io_mapped_close(fa_io_handle_t handle)
+{
+	fa_io_mapping_t* mapping = (fa_io_mapping_t*)handle;
+	int result = munmap((void*)mapping->data, mapping->size);
+	free(mapping);
+	return result;
+}
 #elif defined(_WIN32)
 #include <windows.h>
 
-fa_io_handle_t fa_io_open(const char* filename, fa_mode_t mode)
+fa_io_handle_t fa_io_open(const char* filename, fa_mode_t mode, void* context)
 {
 	DWORD access[2] = { GENERIC_READ, GENERIC_WRITE };
 	DWORD share[2] = { FILE_SHARE_READ, 0 };
@@ -126,6 +236,22 @@ size_t fa_io_read(fa_io_handle_t handle, void* buffer, size_t length)
 	return (size_t)readData;
 }
 
+size_t fa_io_pread(fa_io_handle_t handle, void* buffer, size_t length, uint64_t offset)
+{
+	DWORD readData = 0;
+	OVERLAPPED overlapped;
+
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	if (!ReadFile((HANDLE)handle, buffer, length, &readData, &overlapped))
+	{
+		return 0;
+	}
+	return (size_t)readData;
+}
+
 size_t fa_io_write(fa_io_handle_t handle, const void* buffer, size_t length)
 {
 	DWORD writeData;
@@ -174,6 +300,155 @@ size_t fa_io_tell(fa_io_handle_t handle)
 
 	return (size_t)offset.QuadPart;
 }
+
+fa_io_handle_t fa_io_mapped_open(const char* filename, fa_mode_t mode, void* context)
+{
+	fa_io_mapping_t* mapping = NULL;
+	HANDLE handle, fileMapping;
+	LARGE_INTEGER size;
+	void* data;
+
+	if (mode != FA_MODE_READ)
+	{
+		return FA_IO_INVALID_HANDLE;
+	}
+
+	handle = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		return FA_IO_INVALID_HANDLE;
+	}
+
+	do
+	{
+		if (!GetFileSizeEx(handle, &size) || (size.QuadPart == 0))
+		{
+			break;
+		}
+
+		fileMapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (fileMapping == NULL)
+		{
+			break;
+		}
+
+		data = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(fileMapping);
+
+		if (data == NULL)
+		{
+			break;
+		}
+
+		mapping = malloc(sizeof(fa_io_mapping_t));
+		mapping->data = data;
+		mapping->size = size.QuadPart;
+		mapping->offset = 0;
+	}
+	while (0);
+
+	CloseHandle(handle);
+	return mapping != NULL ? (fa_io_handle_t)mapping : FA_IO_INVALID_HANDLE;
+}
+
+int fa_io_mapped_close(fa_io_handle_t handle)
+{
+	fa_io_mapping_t* mapping = (fa_io_mapping_t*)handle;
+	int result = UnmapViewOfFile(mapping->data) != 0 ? 0 : -1;
+	free(mapping);
+	return result;
+}
 #else
 #error I/O layer not implemented for this platform
 #endif
+
+size_t fa_io_mapped_read(fa_io_handle_t handle, void* buffer, size_t length)
+{
+	fa_io_mapping_t* mapping = (fa_io_mapping_t*)handle;
+	uint64_t left = mapping->size - mapping->offset;
+	size_t maxRead = length > left ? (size_t)left : length;
+
+	memcpy(buffer, mapping->data + mapping->offset, maxRead);
+	mapping->offset += maxRead;
+
+	return maxRead;
+}
+
+size_t fa_io_mapped_pread(fa_io_handle_t handle, void* buffer, size_t length, uint64_t offset)
+{
+	fa_io_mapping_t* mapping = (fa_io_mapping_t*)handle;
+	uint64_t left = offset < mapping->size ? mapping->size - offset : 0;
+	size_t maxRead = length > left ? (size_t)left : length;
+
+	memcpy(buffer, mapping->data + offset, maxRead);
+
+	return maxRead;
+}
+
+size_t fa_io_mapped_write(fa_io_handle_t handle, const void* buffer, size_t length)
+{
+	return 0;
+}
+
+int fa_io_mapped_lseek(fa_io_handle_t handle, int64_t offset, fa_seek_t whence)
+{
+	fa_io_mapping_t* mapping = (fa_io_mapping_t*)handle;
+	int64_t origin;
+
+	switch (whence)
+	{
+		default: case FA_SEEK_SET: origin = 0; break;
+		case FA_SEEK_CURR: origin = (int64_t)mapping->offset; break;
+		case FA_SEEK_END: origin = (int64_t)mapping->size; break;
+	}
+
+	if (((origin + offset) < 0) || ((uint64_t)(origin + offset) > mapping->size))
+	{
+		return -1;
+	}
+
+	mapping->offset = (uint64_t)(origin + offset);
+	return 0;
+}
+
+size_t fa_io_mapped_tell(fa_io_handle_t handle)
+{
+	fa_io_mapping_t* mapping = (fa_io_mapping_t*)handle;
+	return (size_t)mapping->offset;
+}
+
+const void* fa_io_mapped_map(fa_io_handle_t handle, uint64_t offset, size_t length)
+{
+	fa_io_mapping_t* mapping = (fa_io_mapping_t*)handle;
+
+	if ((offset > mapping->size) || (length > (mapping->size - offset)))
+	{
+		return NULL;
+	}
+
+	return mapping->data + offset;
+}
+
+fa_io_handle_t fa_io_memory_open(const char* filename, fa_mode_t mode, void* context)
+{
+	const fa_io_mapping_t* source = (const fa_io_mapping_t*)context;
+	fa_io_mapping_t* mapping;
+
+	if ((mode != FA_MODE_READ) || (source == NULL) || (source->data == NULL))
+	{
+		return FA_IO_INVALID_HANDLE;
+	}
+
+	mapping = malloc(sizeof(fa_io_mapping_t));
+	mapping->data = source->data;
+	mapping->size = source->size;
+	mapping->offset = 0;
+
+	return (fa_io_handle_t)mapping;
+}
+
+int fa_io_memory_close(fa_io_handle_t handle)
+{
+	free(handle);
+	return 0;
+}
@@ -0,0 +1,247 @@
+/*
+
+Copyright (c) 2010 Jesper Svennevid
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <filearchive/internal/api.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#pragma warning(disable: 4127)
+#endif
+
+fa_file_t* fa_alloc_file(fa_archive_t* archive)
+{
+	fa_file_t* file = NULL;
+	uint8_t* buffer;
+
+	if (archive->pool.mutex != NULL)
+	{
+		fa_mutex_lock(archive->pool.mutex);
+	}
+
+	if (archive->pool.fileCount > 0)
+	{
+		file = archive->pool.files[--archive->pool.fileCount];
+	}
+
+	if (archive->pool.mutex != NULL)
+	{
+		fa_mutex_unlock(archive->pool.mutex);
+	}
+
+	if (file == NULL)
+	{
+		file = malloc(sizeof(fa_file_t));
+		if (file == NULL)
+		{
+			return NULL;
+		}
+
+		file->buffer.data = NULL;
+	}
+
+	// recycled handles keep their block buffer
+
+	buffer = file->buffer.data;
+	memset(file, 0, sizeof(fa_file_t));
+	file->buffer.data = buffer;
+
+	file->archive = archive;
+	return file;
+}
+
+void fa_free_file(fa_file_t* file)
+{
+	fa_archive_t* archive = file->archive;
+
+	fa_release_codec(archive, file->codec);
+	file->codec = NULL;
+
+	if (archive->pool.mutex != NULL)
+	{
+		fa_mutex_lock(archive->pool.mutex);
+	}
+
+	if (archive->pool.fileCount < FA_ARCHIVE_POOL_SIZE)
+	{
+		archive->pool.files[archive->pool.fileCount++] = file;
+		file = NULL;
+	}
+
+	if (archive->pool.mutex != NULL)
+	{
+		fa_mutex_unlock(archive->pool.mutex);
+	}
+
+	if (file != NULL)
+	{
+		free(file->buffer.data);
+		free(file);
+	}
+}
+
+uint8_t* fa_get_buffer(fa_file_t* file)
+{
+	if (file->buffer.data == NULL)
+	{
+		file->buffer.data = malloc(file->archive->blockSize);
+	}
+
+	return file->buffer.data;
+}
+
+fa_dir_t* fa_alloc_dir(fa_archive_t* archive)
+{
+	fa_dir_t* dir = NULL;
+
+	if (archive->pool.mutex != NULL)
+	{
+		fa_mutex_lock(archive->pool.mutex);
+	}
+
+	if (archive->pool.dirCount > 0)
+	{
+		dir = archive->pool.dirs[--archive->pool.dirCount];
+	}
+
+	if (archive->pool.mutex != NULL)
+	{
+		fa_mutex_unlock(archive->pool.mutex);
+	}
+
+	if (dir == NULL)
+	{
+		dir = malloc(sizeof(fa_dir_t));
+		if (dir == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	memset(dir, 0, sizeof(fa_dir_t));
+
+	dir->archive = archive;
+	return dir;
+}
+
+void fa_free_dir(fa_dir_t* dir)
+{
+	fa_archive_t* archive = dir->archive;
+
+	if (archive->pool.mutex != NULL)
+	{
+		fa_mutex_lock(archive->pool.mutex);
+	}
+
+	if (archive->pool.dirCount < FA_ARCHIVE_POOL_SIZE)
+	{
+		archive->pool.dirs[archive->pool.dirCount++] = dir;
+		dir = NULL;
+	}
+
+	if (archive->pool.mutex != NULL)
+	{
+		fa_mutex_unlock(archive->pool.mutex);
+	}
+
+	free(dir);
+}
+
+fa_codec_t* fa_acquire_codec(fa_archive_t* archive)
+{
+	fa_codec_t* codec = NULL;
+
+	// codecs are taken by files, read-ahead streams and fa_pread() calls from several threads even without FA_MODE_CONCURRENT, so readers always lock
+
+	if (archive->codecs.mutex != NULL)
+	{
+		fa_mutex_lock(archive->codecs.mutex);
+	}
+
+	if (archive->codecs.count > 0)
+	{
+		codec = archive->codecs.free[--archive->codecs.count];
+	}
+
+	if (archive->codecs.mutex != NULL)
+	{
+		fa_mutex_unlock(archive->codecs.mutex);
+	}
+
+	return codec != NULL ? codec : fa_codec_create();
+}
+
+void fa_release_codec(fa_archive_t* archive, fa_codec_t* codec)
+{
+	if (codec == NULL)
+	{
+		return;
+	}
+
+	if (archive->codecs.mutex != NULL)
+	{
+		fa_mutex_lock(archive->codecs.mutex);
+	}
+
+	if (archive->codecs.count < FA_ARCHIVE_POOL_SIZE)
+	{
+		archive->codecs.free[archive->codecs.count++] = codec;
+		codec = NULL;
+	}
+
+	if (archive->codecs.mutex != NULL)
+	{
+		fa_mutex_unlock(archive->codecs.mutex);
+	}
+
+	fa_codec_destroy(codec);
+}
+
+void fa_pool_destroy(fa_archive_t* archive)
+{
+	while (archive->pool.fileCount > 0)
+	{
+		fa_file_t* file = archive->pool.files[--archive->pool.fileCount];
+
+		free(file->buffer.data);
+		free(file);
+	}
+
+	while (archive->pool.dirCount > 0)
+	{
+		free(archive->pool.dirs[--archive->pool.dirCount]);
+	}
+
+	while (archive->codecs.count > 0)
+	{
+		fa_codec_destroy(archive->codecs.free[--archive->codecs.count]);
+	}
+
+	fa_mutex_destroy(archive->pool.mutex);
+	archive->pool.mutex = NULL;
+
+	fa_mutex_destroy(archive->codecs.mutex);
+	archive->codecs.mutex = NULL;
+}
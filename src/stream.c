@@ -0,0 +1,315 @@
+/*
+
+Copyright (c) 2010 Jesper Svennevid
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <filearchive/internal/api.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#pragma warning(disable: 4127)
+#endif
+
+#define FA_STREAM_MAX_DEPTH (64)
+
+typedef struct fa_stream_block_t fa_stream_block_t;
+
+struct fa_stream_block_t
+{
+	uint8_t* data;
+	uint32_t size;
+
+	uint32_t original;	// offset of block in file
+	uint32_t compressed;	// offset of block in entry data
+	uint32_t consumed;	// size of block in entry data
+};
+
+struct fa_stream_t
+{
+	fa_file_t* file;
+	fa_thread_t* thread;
+
+	fa_mutex_t* mutex;
+	fa_cond_t* ready;
+	fa_cond_t* space;
+
+	uint32_t depth;
+	uint32_t head;
+	uint32_t count;
+	uint32_t offset; // consumed bytes in head block
+
+	struct
+	{
+		uint32_t original;
+		uint32_t compressed;
+	} next; // next block to decode
+
+	int stop;
+	int error;
+
+	uint8_t* scratch;
+	fa_codec_t* codec;
+	fa_stream_block_t blocks[1];
+};
+
+static void streamWorker(void* argument);
+
+int fa_set_readahead(fa_file_t* file, uint32_t depth)
+{
+	fa_stream_t* stream;
+	uint32_t i;
+
+	if ((file == NULL) || (file->archive->mode != FA_MODE_READ) || (file->entry->compression == FA_COMPRESSION_NONE))
+	{
+		return -1;
+	}
+
+	fa_stream_destroy(file);
+
+	if (depth == 0)
+	{
+		return 0;
+	}
+
+	depth = depth > FA_STREAM_MAX_DEPTH ? FA_STREAM_MAX_DEPTH : depth;
+
+	stream = malloc(sizeof(fa_stream_t) + (depth - 1) * sizeof(fa_stream_block_t) + depth * file->archive->blockSize);
+	if (stream == NULL)
+	{
+		return -1;
+	}
+
+	memset(stream, 0, sizeof(fa_stream_t));
+
+	stream->file = file;
+	stream->depth = depth;
+
+	for (i = 0; i < depth; ++i)
+	{
+		stream->blocks[i].data = ((uint8_t*)(stream->blocks + depth)) + i * file->archive->blockSize;
+	}
+
+	// decoding continues after the block currently held in the file buffer
+
+	stream->next.original = file->offset.original;
+	stream->next.compressed = file->offset.compressed;
+
+	stream->mutex = fa_mutex_create();
+	stream->ready = fa_cond_create();
+	stream->space = fa_cond_create();
+
+	if ((stream->mutex == NULL) || (stream->ready == NULL) || (stream->space == NULL))
+	{
+		fa_cond_destroy(stream->space);
+		fa_cond_destroy(stream->ready);
+		fa_mutex_destroy(stream->mutex);
+		free(stream);
+		return -1;
+	}
+
+	fa_release_window(file);
+	file->stream = stream;
+
+	stream->thread = fa_thread_create(streamWorker, stream);
+	if (stream->thread == NULL)
+	{
+		fa_stream_destroy(file);
+		return -1;
+	}
+
+	return 0;
+}
+
+size_t fa_stream_read(fa_file_t* file, void* buffer, size_t length)
+{
+	fa_stream_t* stream = file->stream;
+	size_t totalRead = 0;
+
+	fa_mutex_lock(stream->mutex);
+
+	while (length > 0)
+	{
+		fa_stream_block_t* block;
+		size_t maxRead;
+
+		if (stream->count == 0)
+		{
+			if (stream->error || (stream->next.original >= file->entry->size.original))
+			{
+				break;
+			}
+
+			fa_cond_wait(stream->ready, stream->mutex);
+			continue;
+		}
+
+		// the worker never touches the head block while it is queued
+
+		block = &(stream->blocks[stream->head]);
+		fa_mutex_unlock(stream->mutex);
+
+		maxRead = length > (block->size - stream->offset) ? (block->size - stream->offset) : length;
+		memcpy(buffer, block->data + stream->offset, maxRead);
+
+		buffer = ((uint8_t*)buffer) + maxRead;
+		length -= maxRead;
+		totalRead += maxRead;
+
+		stream->offset += maxRead;
+		file->offset.original += maxRead;
+
+		fa_mutex_lock(stream->mutex);
+
+		if (stream->offset == block->size)
+		{
+			stream->head = (stream->head + 1) % stream->depth;
+			stream->offset = 0;
+			-- stream->count;
+
+			fa_cond_broadcast(stream->space);
+		}
+	}
+
+	fa_mutex_unlock(stream->mutex);
+
+	return totalRead;
+}
+
+int fa_stream_seek(fa_file_t* file, int64_t offset, fa_seek_t whence)
+{
+	uint32_t depth = file->stream->depth;
+	int result;
+
+	// restart read-ahead from the new position
+
+	fa_stream_destroy(file);
+
+	result = fa_lseek(file, offset, whence);
+
+	if (fa_set_readahead(file, depth) < 0)
+	{
+		return -1;
+	}
+
+	return result;
+}
+
+void fa_stream_destroy(fa_file_t* file)
+{
+	fa_stream_t* stream = file->stream;
+
+	if (stream == NULL)
+	{
+		return;
+	}
+
+	if (stream->thread != NULL)
+	{
+		fa_mutex_lock(stream->mutex);
+		stream->stop = 1;
+		fa_cond_broadcast(stream->space);
+		fa_mutex_unlock(stream->mutex);
+
+		fa_thread_join(stream->thread);
+	}
+
+	// leave the file positioned as if the consumed blocks had been read by fa_read()
+
+	if ((stream->count > 0) && (stream->offset > 0))
+	{
+		fa_stream_block_t* block = &(stream->blocks[stream->head]);
+
+		memcpy(file->buffer.data, block->data, block->size);
+
+		file->buffer.offset = stream->offset;
+		file->buffer.fill = block->size;
+
+		file->offset.original = block->original + block->size;
+		file->offset.compressed = block->compressed + block->consumed;
+	}
+	else if (file->buffer.offset == file->buffer.fill)
+	{
+		file->buffer.offset = 0;
+		file->buffer.fill = 0;
+
+		file->offset.original = stream->count > 0 ? stream->blocks[stream->head].original : stream->next.original;
+		file->offset.compressed = stream->count > 0 ? stream->blocks[stream->head].compressed : stream->next.compressed;
+	}
+
+	fa_cond_destroy(stream->space);
+	fa_cond_destroy(stream->ready);
+	fa_mutex_destroy(stream->mutex);
+	free(stream->scratch);
+	fa_release_codec(file->archive, stream->codec);
+	free(stream);
+
+	file->stream = NULL;
+}
+
+static void streamWorker(void* argument)
+{
+	fa_stream_t* stream = (fa_stream_t*)argument;
+	const fa_file_t* file = stream->file;
+
+	fa_mutex_lock(stream->mutex);
+
+	while (!stream->stop)
+	{
+		fa_stream_block_t* block;
+		int decoded;
+
+		if ((stream->count == stream->depth) || stream->error || (stream->next.original >= file->entry->size.original))
+		{
+			fa_cond_wait(stream->space, stream->mutex);
+			continue;
+		}
+
+		block = &(stream->blocks[(stream->head + stream->count) % stream->depth]);
+		block->original = stream->next.original;
+		block->compressed = stream->next.compressed;
+
+		fa_mutex_unlock(stream->mutex);
+
+		decoded = fa_load_block(file, block->compressed, block->original, block->data, file->archive->blockSize, &(stream->scratch), &(stream->codec), &(block->consumed));
+
+		fa_mutex_lock(stream->mutex);
+
+		if (decoded <= 0)
+		{
+			stream->error = 1;
+		}
+		else
+		{
+			block->size = decoded;
+
+			stream->next.original += decoded;
+			stream->next.compressed += block->consumed;
+			++ stream->count;
+		}
+
+		fa_cond_broadcast(stream->ready);
+	}
+
+	fa_mutex_unlock(stream->mutex);
+}
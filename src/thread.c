@@ -0,0 +1,339 @@
+/*
+
+Copyright (c) 2010 Jesper Svennevid
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <filearchive/internal/api.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <pthread.h>
+
+struct fa_mutex_t
+{
+	pthread_mutex_t mutex;
+};
+
+fa_mutex_t* fa_mutex_create()
+{
+	fa_mutex_t* mutex = malloc(sizeof(fa_mutex_t));
+
+	if ((mutex != NULL) && pthread_mutex_init(&(mutex->mutex), NULL))
+	{
+		free(mutex);
+		return NULL;
+	}
+
+	return mutex;
+}
+
+void fa_mutex_destroy(fa_mutex_t* mutex)
+{
+	if (mutex == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_destroy(&(mutex->mutex));
+	free(mutex);
+}
+
+void fa_mutex_lock(fa_mutex_t* mutex)
+{
+	pthread_mutex_lock(&(mutex->mutex));
+}
+
+void fa_mutex_unlock(fa_mutex_t* mutex)
+{
+	pthread_mutex_unlock(&(mutex->mutex));
+}
+
+struct fa_cond_t
+{
+	pthread_cond_t cond;
+};
+
+fa_cond_t* fa_cond_create()
+{
+	fa_cond_t* cond = malloc(sizeof(fa_cond_t));
+
+	if ((cond != NULL) && pthread_cond_init(&(cond->cond), NULL))
+	{
+		free(cond);
+		return NULL;
+	}
+
+	return cond;
+}
+
+void fa_cond_destroy(fa_cond_t* cond)
+{
+	if (cond == NULL)
+	{
+		return;
+	}
+
+	pthread_cond_destroy(&(cond->cond));
+	free(cond);
+}
+
+void fa_cond_wait(fa_cond_t* cond, fa_mutex_t* mutex)
+{
+	pthread_cond_wait(&(cond->cond), &(mutex->mutex));
+}
+
+void fa_cond_broadcast(fa_cond_t* cond)
+{
+	pthread_cond_broadcast(&(cond->cond));
+}
+
+struct fa_thread_t
+{
+	pthread_t thread;
+	void (*function)(void*);
+	void* argument;
+};
+
+static void* threadEntry(void* argument)
+{
+	fa_thread_t* thread = (fa_thread_t*)argument;
+	thread->function(thread->argument);
+	return NULL;
+}
+
+fa_thread_t* fa_thread_create(void (*function)(void*), void* argument)
+{
+	fa_thread_t* thread = malloc(sizeof(fa_thread_t));
+
+	if (thread == NULL)
+	{
+		return NULL;
+	}
+
+	thread->function = function;
+	thread->argument = argument;
+
+	if (pthread_create(&(thread->thread), NULL, threadEntry, thread))
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void fa_thread_join(fa_thread_t* thread)
+{
+	if (thread == NULL)
+	{
+		return;
+	}
+
+	pthread_join(thread->thread, NULL);
+	free(thread);
+}
+
+#elif defined(_WIN32)
+#include <windows.h>
+
+struct fa_mutex_t
+{
+	CRITICAL_SECTION section;
+};
+
+fa_mutex_t* fa_mutex_create()
+{
+	fa_mutex_t* mutex = malloc(sizeof(fa_mutex_t));
+
+	if (mutex != NULL)
+	{
+		InitializeCriticalSection(&(mutex->section));
+	}
+
+	return mutex;
+}
+
+void fa_mutex_destroy(fa_mutex_t* mutex)
+{
+	if (mutex == NULL)
+	{
+		return;
+	}
+
+	DeleteCriticalSection(&(mutex->section));
+	free(mutex);
+}
+
+void fa_mutex_lock(fa_mutex_t* mutex)
+{
+	EnterCriticalSection(&(mutex->section));
+}
+
+void fa_mutex_unlock(fa_mutex_t* mutex)
+{
+	LeaveCriticalSection(&(mutex->section));
+}
+
+struct fa_cond_t
+{
+	CONDITION_VARIABLE cond;
+};
+
+fa_cond_t* fa_cond_create()
+{
+	fa_cond_t* cond = malloc(sizeof(fa_cond_t));
+
+	if (cond != NULL)
+	{
+		InitializeConditionVariable(&(cond->cond));
+	}
+
+	return cond;
+}
+
+void fa_cond_destroy(fa_cond_t* cond)
+{
+	free(cond);
+}
+
+void fa_cond_wait(fa_cond_t* cond, fa_mutex_t* mutex)
+{
+	SleepConditionVariableCS(&(cond->cond), &(mutex->section), INFINITE);
+}
+
+void fa_cond_broadcast(fa_cond_t* cond)
+{
+	WakeAllConditionVariable(&(cond->cond));
+}
+
+struct fa_thread_t
+{
+	HANDLE thread;
+	void (*function)(void*);
+	void* argument;
+};
+
+static DWORD WINAPI threadEntry(LPVOID argument)
+{
+	fa_thread_t* thread = (fa_thread_t*)argument;
+	thread->function(thread->argument);
+	return 0;
+}
+
+fa_thread_t* fa_thread_create(void (*function)(void*), void* argument)
+{
+	fa_thread_t* thread = malloc(sizeof(fa_thread_t));
+
+	if (thread == NULL)
+	{
+		return NULL;
+	}
+
+	thread->function = function;
+	thread->argument = argument;
+
+	thread->thread = CreateThread(NULL, 0, threadEntry, thread, 0, NULL);
+	if (thread->thread == NULL)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void fa_thread_join(fa_thread_t* thread)
+{
+	if (thread == NULL)
+	{
+		return;
+	}
+
+	WaitForSingleObject(thread->thread, INFINITE);
+	CloseHandle(thread->thread);
+	free(thread);
+}
+
+#else
+
+// single-threaded platforms: nothing runs concurrently, so locks do nothing and starting a thread fails
+
+struct fa_mutex_t
+{
+	int unused;
+};
+
+struct fa_cond_t
+{
+	int unused;
+};
+
+static fa_mutex_t dummyMutex;
+static fa_cond_t dummyCond;
+
+fa_mutex_t* fa_mutex_create()
+{
+	return &dummyMutex;
+}
+
+void fa_mutex_destroy(fa_mutex_t* mutex)
+{
+}
+
+void fa_mutex_lock(fa_mutex_t* mutex)
+{
+}
+
+void fa_mutex_unlock(fa_mutex_t* mutex)
+{
+}
+
+fa_cond_t* fa_cond_create()
+{
+	return &dummyCond;
+}
+
+void fa_cond_destroy(fa_cond_t* cond)
+{
+}
+
+void fa_cond_wait(fa_cond_t* cond, fa_mutex_t* mutex)
+{
+}
+
+void fa_cond_broadcast(fa_cond_t* cond)
+{
+}
+
+fa_thread_t* fa_thread_create(void (*function)(void*), void* argument)
+{
+	return NULL;
+}
+
+void fa_thread_join(fa_thread_t* thread)
+{
+}
+
+#endif
@@ -32,27 +32,40 @@ typedef enum
 	State_Files
 } State;
 
+typedef int (*VisitFile)(const char* path, const char* internalPath, void* userdata);
+
+typedef struct
+{
+	fa_archive_t* archive;
+	int compression;
+	int verbose;
+} AddContext;
+
+typedef struct
+{
+	char* data;
+	size_t size;
+	size_t capacity;
+
+	size_t* sizes;
+	uint32_t count;
+
+	uint32_t blockSize;
+} Samples;
+
 static int addSpecFile(fa_archive_t* archive, const char* specFile, int compression, int verbose)
 {
 	fprintf(stderr, "create: Support for spec files not complete\n");
 	return -1;
 }
 
-static int addFile(fa_archive_t* archive, const char* path, const char* internalPath, int compression, int verbose)
+static int visitPath(const char* path, const char* internalPath, VisitFile visit, void* userdata)
 {
 #if defined(_WIN32)
 	DWORD attrs;
 #else
 	struct stat fs;
 #endif
-	fa_file_t* file = NULL;
-	FILE* inp = NULL;
-	int result = -1;
-
-	if ('@' == *path)
-	{
-		return addSpecFile(archive, path+1, compression, verbose);
-	}
 
 #if defined(_WIN32)
 	if ((attrs = GetFileAttributes(path)) == INVALID_FILE_ATTRIBUTES)
@@ -84,7 +97,7 @@ static int addFile(fa_archive_t* archive, const char* path, const char* internal
 				sprintf_s(newPath, sizeof(newPath), "%s\\%s", path, data.cFileName);
 				sprintf_s(newInternalPath, sizeof(newPath), "%s\\%s", internalPath, data.cFileName);
 
-				if (addFile(archive, newPath, newInternalPath, compression, verbose) < 0)
+				if (visitPath(newPath, newInternalPath, visit, userdata) < 0)
 				{
 					FindClose(dh);
 					return -1;
@@ -128,7 +141,7 @@ static int addFile(fa_archive_t* archive, const char* path, const char* internal
 			snprintf(newPath, sizeof(newPath), "%s/%s", path, dirEntry->d_name);
 			snprintf(newInternalPath, sizeof(newPath), "%s/%s", internalPath, dirEntry->d_name);
 
-			if (addFile(archive, newPath, newInternalPath, compression, verbose) < 0)
+			if (visitPath(newPath, newInternalPath, visit, userdata) < 0)
 			{
 				closedir(dir);
 				return -1;
@@ -140,6 +153,19 @@ static int addFile(fa_archive_t* archive, const char* path, const char* internal
 	}
 #endif
 
+	return visit(path, internalPath, userdata);
+}
+
+static int writeFile(const char* path, const char* internalPath, void* userdata)
+{
+	const AddContext* context = (const AddContext*)userdata;
+	fa_archive_t* archive = context->archive;
+	int compression = context->compression;
+	int verbose = context->verbose;
+	fa_file_t* file = NULL;
+	FILE* inp = NULL;
+	int result = -1;
+
 	do
 	{
 		char buf[16384];
@@ -208,6 +234,121 @@ static int addFile(fa_archive_t* archive, const char* path, const char* internal
 	return result;
 }
 
+static int addFile(fa_archive_t* archive, const char* path, const char* internalPath, int compression, int verbose)
+{
+	AddContext context;
+
+	if ('@' == *path)
+	{
+		return addSpecFile(archive, path+1, compression, verbose);
+	}
+
+	context.archive = archive;
+	context.compression = compression;
+	context.verbose = verbose;
+
+	return visitPath(path, internalPath, writeFile, &context);
+}
+
+static int sampleFile(const char* path, const char* internalPath, void* userdata)
+{
+	Samples* samples = (Samples*)userdata;
+	FILE* inp;
+	size_t bufsize;
+
+	inp = fopen(path, "rb");
+	if (inp == NULL)
+	{
+		fprintf(stderr, "create: Failed opening file \"%s\" for reading\n", path);
+		return -1;
+	}
+
+	// split files the same way the archive splits them into blocks
+
+	while ((samples->size < samples->capacity) && ((bufsize = fread(samples->data + samples->size, 1, (samples->capacity - samples->size) < samples->blockSize ? (samples->capacity - samples->size) : samples->blockSize, inp)) != 0))
+	{
+		size_t* sizes = realloc(samples->sizes, (samples->count + 1) * sizeof(size_t));
+		if (sizes == NULL)
+		{
+			fclose(inp);
+			return -1;
+		}
+
+		samples->sizes = sizes;
+		samples->sizes[samples->count++] = bufsize;
+		samples->size += bufsize;
+	}
+
+	fclose(inp);
+	return 0;
+}
+
+static int trainDictionary(fa_archive_t* archive, int argc, char* argv[], int first, size_t dictionarySize, uint32_t blockSize, int verbose)
+{
+	Samples samples;
+	void* dictionary = NULL;
+	size_t size = 0;
+	int i, result = -1;
+
+	memset(&samples, 0, sizeof(samples));
+
+	// samples are cut at the block size the archive compresses with; the trainer wants roughly a hundred times the dictionary size in samples, and enough of them when blocks are large
+
+	samples.blockSize = blockSize > 0 ? blockSize : FA_BLOCK_SIZE_DEFAULT;
+	samples.capacity = dictionarySize * 100;
+	samples.capacity = samples.capacity < (size_t)samples.blockSize * 32 ? (size_t)samples.blockSize * 32 : samples.capacity;
+	samples.data = malloc(samples.capacity);
+	dictionary = malloc(dictionarySize);
+
+	do
+	{
+		if ((samples.data == NULL) || (dictionary == NULL))
+		{
+			break;
+		}
+
+		for (i = first; i < argc; ++i)
+		{
+			if (('@' != *argv[i]) && (visitPath(argv[i], argv[i], sampleFile, &samples) < 0))
+			{
+				break;
+			}
+		}
+
+		if (i < argc)
+		{
+			break;
+		}
+
+		size = fa_train_dictionary(dictionary, dictionarySize, samples.data, samples.sizes, samples.count);
+		if (size == 0)
+		{
+			fprintf(stderr, "create: Failed training dictionary from %u samples\n", samples.count);
+			break;
+		}
+
+		if (fa_set_dictionary(archive, dictionary, size) < 0)
+		{
+			fprintf(stderr, "create: Failed setting dictionary\n");
+			break;
+		}
+
+		if (verbose > 0)
+		{
+			fprintf(stderr, "Dictionary: %lu bytes (trained from %u samples, %lu bytes)\n", (unsigned long)size, samples.count, (unsigned long)samples.size);
+		}
+
+		result = 0;
+	}
+	while (0);
+
+	free(dictionary);
+	free(samples.sizes);
+	free(samples.data);
+
+	return result;
+}
+
 int commandCreate(int argc, char* argv[])
 {
 	int i, result;
@@ -216,8 +357,13 @@ int commandCreate(int argc, char* argv[])
 
 	fa_compression_t compression = FA_COMPRESSION_NONE;
 	uint32_t blockAlignment = 0;
+	size_t dictionarySize = 0;
+	uint32_t blockSize = 0;
+	fa_compression_options_t options;
 	int verbose = 0;
 
+	memset(&options, 0, sizeof(options));
+
 	result = 0;
 	for (i = 2; (i < argc) && (result == 0); ++i)
 	{
@@ -261,6 +407,22 @@ int commandCreate(int argc, char* argv[])
 					{
 						compression = FA_COMPRESSION_LZMA2;
 					}
+#endif
+#if defined(FA_ZSTD_ENABLE)
+					else if (!strcmp("zstd", argv[i]))
+					{
+						compression = FA_COMPRESSION_ZSTD;
+					}
+#endif
+#if defined(FA_LZ4_ENABLE)
+					else if (!strcmp("lz4", argv[i]))
+					{
+						compression = FA_COMPRESSION_LZ4;
+					}
+					else if (!strcmp("lz4hc", argv[i]))
+					{
+						compression = FA_COMPRESSION_LZ4HC;
+					}
 #endif
 					else
 					{
@@ -277,6 +439,54 @@ int commandCreate(int argc, char* argv[])
 				{
 					blockAlignment = 2048;
 				}
+				else if (!strcmp("-d", argv[i]))
+				{
+					if ((i + 1) == argc)
+					{
+						fprintf(stderr, "create: Missing dictionary size\n");
+						result = -1;
+						break;
+					}
+					++i;
+
+					dictionarySize = strtoul(argv[i], NULL, 10);
+					if (dictionarySize < 1024)
+					{
+						fprintf(stderr, "create: Invalid dictionary size \"%s\"\n", argv[i]);
+						result = -1;
+						break;
+					}
+				}
+				else if (!strcmp("-b", argv[i]))
+				{
+					if ((i + 1) == argc)
+					{
+						fprintf(stderr, "create: Missing block size\n");
+						result = -1;
+						break;
+					}
+					++i;
+
+					blockSize = strtoul(argv[i], NULL, 10);
+				}
+				else if (!strcmp("-l", argv[i]))
+				{
+					if ((i + 1) == argc)
+					{
+						fprintf(stderr, "create: Missing compression level\n");
+						result = -1;
+						break;
+					}
+					++i;
+
+					options.level = atoi(argv[i]);
+					if ((options.level < FA_COMPRESSION_LEVEL_FASTEST) || (options.level > FA_COMPRESSION_LEVEL_BEST))
+					{
+						fprintf(stderr, "create: Invalid compression level \"%s\"\n", argv[i]);
+						result = -1;
+						break;
+					}
+				}
 				else
 				{
 					fprintf(stderr, "create: Unknown option \"%s\"\n", argv[i]);
@@ -296,6 +506,37 @@ int commandCreate(int argc, char* argv[])
 					result = -1;
 					break;
 				}
+
+				if (fa_set_compression_options(archive, &options) < 0)
+				{
+					fprintf(stderr, "create: Failed to set compression options\n");
+					result = -1;
+					break;
+				}
+
+				if ((blockSize > 0) && (fa_set_block_size(archive, blockSize) < 0))
+				{
+					fprintf(stderr, "create: Invalid block size \"%u\" (must be a power of two from %u to %u)\n", blockSize, FA_BLOCK_SIZE_DEFAULT, FA_BLOCK_SIZE_MAX);
+					result = -1;
+					break;
+				}
+
+				if (dictionarySize > 0)
+				{
+					if (compression != FA_COMPRESSION_ZSTD)
+					{
+						fprintf(stderr, "create: Dictionaries are only used with zstd compression\n");
+						result = -1;
+						break;
+					}
+
+					if (trainDictionary(archive, argc, argv, i + 1, dictionarySize, blockSize, verbose) < 0)
+					{
+						result = -1;
+						break;
+					}
+				}
+
 				state = State_Files;
 			}
 			break;
@@ -8,6 +8,12 @@ static const char* compression_methods = "none fastlz"
 #if defined(FA_LZMA_ENABLE)
 " lzma2"
 #endif
+#if defined(FA_ZSTD_ENABLE)
+" zstd"
+#endif
+#if defined(FA_LZ4_ENABLE)
+" lz4 lz4hc"
+#endif
 ;
 
 void commandHelp(char* command)
@@ -35,6 +41,9 @@ void commandHelp(char* command)
 		fprintf(stderr, "Options are:\n");
 		fprintf(stderr, "\t-z <compression>   Select compression method: %s (default: none) (global/spec)\n", compression_methods);
 		fprintf(stderr, "\t-s                 Optimize layout for optical media (align access to block boundaries) (global)\n");
+		fprintf(stderr, "\t-l <level>         Compression level from 1 (fastest) to 9 (smallest) (default: per compression method) (global)\n");
+		fprintf(stderr, "\t-b <size>          Compress files in blocks of <size> bytes, a power of two from 16384 to 1048576 (default: 16384) (global)\n");
+		fprintf(stderr, "\t-d <size>          Train a compression dictionary of up to <size> bytes from the input files (zstd only) (global)\n");
 		fprintf(stderr, "\t-v                 Enabled verbose output (global)\n");
 		fprintf(stderr, "\n<archive> = Archive file to create\n");
 		fprintf(stderr, "<spec> = File spec to read files description from (files are gathered relative to spec path)\n");
@@ -4,61 +4,35 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int listDirectory(fa_archive_t* archive, const char* path)
+static int listEntry(const char* path, const fa_dirinfo_t* info, void* userdata)
 {
-	fa_dir_t* dir;
-	int result = -1;
+	int* files = (int*)userdata;
 
-	do
+	if (info->type == FA_ENTRY_DIR)
 	{
-		fa_dirinfo_t info;
-		int files = 0;
+		*files = 0;
+	}
+	else if (info->type == FA_ENTRY_FILE)
+	{
+		char hash[sizeof(fa_hash_t) * 2 + 1];
+		int i;
 
-		dir = fa_opendir(archive, path);
-		if (dir == NULL)
+		if (*files == 0)
 		{
-			fprintf(stderr, "list: Failed to open archive directory \"%s\"\n", path);
-			break;
+			const char* name = strrchr(path, '/');
+			fprintf(stdout, "Dir: \"%.*s\"\n", name != NULL ? (int)(name - path) + 1 : 0, path);
+			*files = 1;
 		}
 
-		while (fa_readdir(dir, &info) == 0)
+		for (i = 0; i < sizeof(fa_hash_t); ++i)
 		{
-			if (info.type == FA_ENTRY_DIR)
-			{
-				char* buf = malloc(strlen(path) + strlen(info.name) + 2);
-				sprintf(buf, "%s%s/", path, info.name);
-
-				listDirectory(archive, buf);
-
-				free(buf);
-			}
-			else if (info.type == FA_ENTRY_FILE)
-			{
-				char hash[sizeof(fa_hash_t) * 2 + 1];
-				int i;
-
-				if (files == 0)
-				{
-					fprintf(stdout, "Dir: \"%s\"\n", path);
-					files = 1;
-				}
-
-				for (i = 0; i < sizeof(fa_hash_t); ++i)
-				{
-					sprintf(hash + i * 2, "%02x", info.hash.data[i]);
-				}
-
-				fprintf(stdout, "File: \"%s\", %u bytes (%u bytes compressed, ratio %.2f%%), hash: %s\n", info.name, info.size.original, info.size.compressed, info.size.original > 0 ? (info.size.compressed * 100.0f) / info.size.original : 0, hash);
-			}
-		} 
+			sprintf(hash + i * 2, "%02x", info->hash.data[i]);
+		}
 
-		result = 0;
+		fprintf(stdout, "File: \"%s\", %u bytes (%u bytes compressed, ratio %.2f%%), hash: %s\n", info->name, info->size.original, info->size.compressed, info->size.original > 0 ? (info->size.compressed * 100.0f) / info->size.original : 0, hash);
 	}
-	while (0);
-
-	fa_closedir(dir);
 
-	return result;
+	return 0;
 }
 
 static int listArchive(const char* path)
@@ -70,6 +44,7 @@ static int listArchive(const char* path)
 	{
 		fa_archiveinfo_t info;
 		char hash[sizeof(fa_hash_t) * 2 + 1];
+		int files;
 		int i;
 
 		archive = fa_open_archive(path, FA_MODE_READ, 0, &info);
@@ -81,7 +56,14 @@ static int listArchive(const char* path)
 
 		fprintf(stdout, "Archive: \"%s\"\n", path);
 
-		result = listDirectory(archive, "");
+		files = 0;
+		if (fa_walk(archive, "", listEntry, &files) < 0)
+		{
+			fprintf(stderr, "list: Failed to enumerate archive \"%s\"\n", path);
+			break;
+		}
+
+		result = 0;
 
 		for (i = 0; i < sizeof(fa_hash_t); ++i)
 		{
@@ -4,6 +4,9 @@ Build {
 	Units = "units.lua",
 	SyntaxExtensions = { "tundra.syntax.glob" },
 
+	SubVariants = { "default", "codecs" },
+	DefaultSubVariant = "default",
+
 	Configs = {
 		Config { Name = "win32-msvc", Inherit = common, Tools = { { "msvc-winsdk"; TargetArch = "x86" } } },
 		Config { Name = "win64-msvc", Inherit = common, Tools = { { "msvc-winsdk"; TargetArch = "x64" } } },
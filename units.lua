@@ -21,18 +21,21 @@ StaticLibrary
 
 		Libs = {
 			{ "z"; Config = "macosx-*-*-*" },
-			{ "z", "lzma"; Config = "linux-*-*-*" },
+			{ "z", "lzma", "pthread"; Config = "linux-*-*-*" },
+			{ "zstd", "lz4"; Config = "linux-*-*-codecs" },
 		},
 
 		Defines = {
 			{ "FA_ZLIB_ENABLE"; Config = "macosx-*-*-*" },
 			{ "FA_ZLIB_ENABLE", "FA_LZMA_ENABLE"; Config = "linux-*-*-*" },
+			{ "FA_ZSTD_ENABLE", "FA_LZ4_ENABLE"; Config = "linux-*-*-codecs" },
 		}
 	},
 
 	Defines = {
 		{ "FA_ZLIB_ENABLE"; Config = "macosx-*-*-*" },
-		{ "FA_ZLIB_ENABLE", "FA_LZMA_ENABLE"; Config = "linux-*-*-*" },
+		{ "FA_ZLIB_ENABLE", "FA_LZMA_ENABLE", "FA_URING_ENABLE"; Config = "linux-*-*-*" },
+		{ "FA_ZSTD_ENABLE", "FA_LZ4_ENABLE"; Config = "linux-*-*-codecs" },
 	},
 
 	Env = {